@@ -0,0 +1,261 @@
+# -*- coding: utf-8 -*-
+"""The benchmarks. Each one is a name and a setup function that returns what
+gets timed. Loops that run inside JS do LOOP iterations per call, so their
+times are per LOOP crossings."""
+
+import types
+
+from v8py import Context, Script, JSException
+
+LOOP = 1000
+BENCHMARKS = []
+
+
+def benchmark(name):
+    def register(setup):
+        BENCHMARKS.append((name, setup))
+        return setup
+    return register
+
+
+def js_loop(body):
+    return Script('for (var i = 0; i < %d; i++) { %s }' % (LOOP, body))
+
+
+# contexts
+
+@benchmark('context_create')
+def context_create():
+    return Context
+
+
+@benchmark('context_clone')
+def context_clone():
+    context = Context()
+    context.expose(*make_functions(100))
+    return context.clone
+
+
+# eval
+
+@benchmark('eval_script')
+def eval_script():
+    context = Context()
+    script = Script('1')
+    return lambda: context.eval(script)
+
+
+@benchmark('eval_source')
+def eval_source():
+    # the same source every time, so this is mostly the script cache
+    context = Context()
+    return lambda: context.eval('1')
+
+
+@benchmark('eval_with_timeout')
+def eval_with_timeout():
+    context = Context(timeout=10)
+    script = Script('1')
+    return lambda: context.eval(script)
+
+
+# calling JS from Python
+
+@benchmark('js_function_call_0_args')
+def js_function_call_0_args():
+    function = Context().eval('(function () {})')
+    return function
+
+
+@benchmark('js_function_call_3_args')
+def js_function_call_3_args():
+    function = Context().eval('(function (a, b, c) {})')
+    return lambda: function(1, 'two', 3.0)
+
+
+@benchmark('js_function_map_%d' % LOOP)
+def js_function_map():
+    function = Context().eval('(function (a) { return a; })')
+    args = list(range(LOOP))
+    return lambda: list(function.map(args))
+
+
+# conversions, by type and size. Setting a global converts Python to JS,
+# getting it converts back.
+
+def conversion_values():
+    yield 'int', 1
+    yield 'float', 1.5
+    yield 'bool', True
+    yield 'none', None
+    for size in (10, 1000, 100000):
+        yield 'str_%d' % size, 'x' * size
+        yield 'unicode_%d' % size, u'☃' * size
+    for size in (10, 1000):
+        yield 'list_%d' % size, list(range(size))
+        yield 'tuple_%d' % size, tuple(range(size))
+        yield 'dict_%d' % size, dict(('key%d' % i, i) for i in range(size))
+    yield 'object', object()
+
+
+def conversion_benchmarks(name, value):
+    @benchmark('js_from_py_' + name)
+    def js_from_py():
+        context = Context()
+        return lambda: setattr(context, 'value', value)
+
+    @benchmark('py_from_js_' + name)
+    def py_from_js():
+        context = Context()
+        context.value = value
+        return lambda: context.value
+
+for name, value in conversion_values():
+    conversion_benchmarks(name, value)
+
+
+# exposing things
+
+def make_functions(count):
+    functions = []
+    for i in range(count):
+        def function():
+            pass
+        function.__name__ = 'function%d' % i
+        functions.append(function)
+    return functions
+
+
+@benchmark('expose_100_functions')
+def expose_functions():
+    functions = make_functions(100)
+    return lambda: Context().expose(*functions)
+
+
+@benchmark('expose_module_1000')
+def expose_module():
+    module = types.ModuleType('big')
+    for function in make_functions(1000):
+        setattr(module, function.__name__, function)
+    return lambda: Context().expose_module(module)
+
+
+# calling Python from JS
+
+@benchmark('py_function_callback_x%d' % LOOP)
+def py_function_callback():
+    context = Context()
+    context.expose(make_functions(1)[0])
+    script = js_loop('function0(i)')
+    return lambda: context.eval(script)
+
+
+class Thing(object):
+    def __init__(self):
+        self.attribute = 1
+        self.items = list(range(10))
+
+    def method(self):
+        pass
+
+    @property
+    def prop(self):
+        return 1
+
+    def __getitem__(self, index):
+        return self.items[index]
+
+    def __len__(self):
+        return len(self.items)
+
+
+def thing_context():
+    context = Context()
+    context.expose(Thing)
+    context.thing = Thing()
+    return context
+
+
+@benchmark('interceptor_get_attribute_x%d' % LOOP)
+def interceptor_get_attribute():
+    context = thing_context()
+    script = js_loop('thing.attribute')
+    return lambda: context.eval(script)
+
+
+@benchmark('interceptor_set_attribute_x%d' % LOOP)
+def interceptor_set_attribute():
+    context = thing_context()
+    script = js_loop('thing.attribute = i')
+    return lambda: context.eval(script)
+
+
+@benchmark('interceptor_property_x%d' % LOOP)
+def interceptor_property():
+    context = thing_context()
+    script = js_loop('thing.prop')
+    return lambda: context.eval(script)
+
+
+@benchmark('interceptor_method_x%d' % LOOP)
+def interceptor_method():
+    context = thing_context()
+    script = js_loop('thing.method()')
+    return lambda: context.eval(script)
+
+
+@benchmark('interceptor_indexed_x%d' % LOOP)
+def interceptor_indexed():
+    context = thing_context()
+    script = js_loop('thing[i % 10]')
+    return lambda: context.eval(script)
+
+
+@benchmark('construct_x%d' % LOOP)
+def construct():
+    context = thing_context()
+    script = js_loop('new Thing()')
+    return lambda: context.eval(script)
+
+
+# exceptions
+
+@benchmark('exception_js_to_py')
+def exception_js_to_py():
+    context = Context()
+    script = Script('function thrower() { throw new Error("kappa"); } thrower()')
+
+    def run():
+        try:
+            context.eval(script)
+        except JSException:
+            pass
+    return run
+
+
+@benchmark('exception_py_through_js')
+def exception_py_through_js():
+    context = Context()
+
+    def raiser():
+        raise ValueError('kappa')
+    context.expose(raiser)
+    script = Script('raiser()')
+
+    def run():
+        try:
+            context.eval(script)
+        except ValueError:
+            pass
+    return run
+
+
+@benchmark('exception_py_caught_in_js_x%d' % LOOP)
+def exception_py_caught_in_js():
+    context = Context()
+
+    def raiser():
+        raise ValueError('kappa')
+    context.expose(raiser)
+    script = js_loop('try { raiser(); } catch (e) {}')
+    return lambda: context.eval(script)
@@ -0,0 +1,127 @@
+"""Times the cost of crossing between Python and JavaScript.
+
+    python benchmarks/run.py                    run everything and print it
+    python benchmarks/run.py -k from_py         only benchmarks matching from_py
+    python benchmarks/run.py --save before      also store the results as a baseline
+    python benchmarks/run.py --compare before   compare against a stored baseline
+
+Baselines are JSON files in benchmarks/baselines. They're only comparable on
+the same machine with the same Python and V8, so they aren't checked in.
+"""
+
+from __future__ import print_function
+
+import argparse
+import io
+import json
+import os
+import platform
+import sys
+import timeit
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import cases
+
+BASELINE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'baselines')
+
+
+def measure(function, min_time, repeat):
+    """Returns the best time per call in seconds. The number of calls per
+    repeat is picked so each repeat takes at least min_time."""
+    timer = timeit.Timer(function)
+    number = 1
+    while True:
+        elapsed = timer.timeit(number)
+        if elapsed >= min_time:
+            break
+        number *= 10 if elapsed < min_time / 10 else 2
+    times = [elapsed] + timer.repeat(repeat - 1, number)
+    return min(times) / number
+
+
+def run(pattern, min_time, repeat):
+    results = {}
+    for name, setup in cases.BENCHMARKS:
+        if pattern and pattern not in name:
+            continue
+        # setup makes the context and whatever else, and returns the thing to
+        # time, so none of that gets counted
+        results[name] = measure(setup(), min_time, repeat)
+        print('%-45s %s' % (name, format_time(results[name])))
+    return results
+
+
+def format_time(seconds):
+    for unit, scale in (('s', 1), ('ms', 1e3), ('us', 1e6)):
+        if seconds * scale >= 1:
+            return '%8.2f %s' % (seconds * scale, unit)
+    return '%8.2f ns' % (seconds * 1e9)
+
+
+def baseline_path(name):
+    return os.path.join(BASELINE_DIR, name + '.json')
+
+
+def save(name, results):
+    if not os.path.isdir(BASELINE_DIR):
+        os.makedirs(BASELINE_DIR)
+    baseline = {
+        'python': platform.python_version(),
+        'machine': platform.machine(),
+        'results': results,
+    }
+    with io.open(baseline_path(name), 'w') as f:
+        f.write(json.dumps(baseline, indent=2, sort_keys=True))
+
+
+def compare(name, results, threshold):
+    """Prints each benchmark against the baseline, and returns the names of
+    the ones that got more than threshold slower."""
+    with io.open(baseline_path(name)) as f:
+        baseline = json.load(f)
+    if baseline['python'] != platform.python_version():
+        print('warning: baseline is from Python %s' % baseline['python'])
+    print()
+    print('%-45s %11s %11s %8s' % ('', name, 'now', 'change'))
+    regressions = []
+    for bench in sorted(results):
+        if bench not in baseline['results']:
+            print('%-45s %11s %s' % (bench, 'new', format_time(results[bench])))
+            continue
+        before = baseline['results'][bench]
+        change = results[bench] / before - 1
+        flag = ''
+        if change > threshold:
+            flag = ' slower'
+            regressions.append(bench)
+        elif change < -threshold:
+            flag = ' faster'
+        print('%-45s %s %s %+7.1f%%%s' % (bench, format_time(before), format_time(results[bench]), change * 100, flag))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-k', dest='pattern', help='only run benchmarks with this in their name')
+    parser.add_argument('--save', metavar='NAME', help='store the results as a baseline')
+    parser.add_argument('--compare', metavar='NAME', help='compare against a stored baseline')
+    parser.add_argument('--threshold', type=float, default=0.1,
+                        help='how much slower counts as a regression (default 0.1 = 10%%)')
+    parser.add_argument('--min-time', type=float, default=0.2,
+                        help='seconds each repeat should take at least')
+    parser.add_argument('--repeat', type=int, default=5)
+    args = parser.parse_args()
+
+    results = run(args.pattern, args.min_time, args.repeat)
+    if args.save:
+        save(args.save, results)
+    if args.compare:
+        regressions = compare(args.compare, results, args.threshold)
+        if regressions:
+            print()
+            print('%d regressions' % len(regressions))
+            sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
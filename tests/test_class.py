@@ -70,3 +70,30 @@ def test_static_method(context):
 def test_hidden_method(context):
     with pytest.raises(v8py.JSException):
         context.eval('new Test().hidden_method()')
+
+def test_unconstructable(context):
+    class Handle(object):
+        __v8py_unconstructable__ = True
+    context.Handle = Handle
+    with pytest.raises(v8py.JSException):
+        context.eval('new Handle()')
+
+def test_construct_with_args(context):
+    class Pair(object):
+        def __init__(self, a, b):
+            self.a = a
+            self.b = b
+    context.Pair = Pair
+    pair = context.eval('new Pair(1, 2)')
+    assert (pair.a, pair.b) == (1, 2)
+
+def test_identity_without_weakref(context):
+    class Slotted(object):
+        __slots__ = ()
+    context.a = Slotted()
+    # objects that can't be weakly referenced still keep their identity
+    assert context.eval('a === a')
+    obj = Slotted()
+    context.b = obj
+    context.c = obj
+    assert context.eval('b === c')
@@ -1,7 +1,7 @@
 import pytest
 import time
 
-from v8py import JavaScriptTerminated, current_context, new
+from v8py import Context, JavaScriptTerminated, current_context, new
 
 def test_glob(context):
     context.eval('foo = "bar"')
@@ -102,9 +102,132 @@ def test_expose_module(context):
     context.expose_module(test_context)
     assert context.eval('f()') is None
 
+def test_expose_module_lazy(context):
+    import types
+    module = types.ModuleType('lazy')
+    module.value = 'value'
+    module.other = 'other'
+    context.expose_module(module)
+    assert 'value' in context.eval('Object.keys(this)')
+    assert context.eval('value') == 'value'
+    assert context.eval('value') == 'value'
+    context.eval('other = "changed"')
+    assert context.eval('other') == 'changed'
+
 def test_current_context(context):
     assert current_context() is None
     def f():
         assert current_context() is context
     context.expose(f)
     context.eval('f()')
+
+def test_close(context):
+    class Test(object): pass
+    context.expose(Test)
+    context.eval('t = new Test()')
+    context.close()
+    with pytest.raises(ValueError):
+        context.eval('1')
+    with pytest.raises(ValueError):
+        context.glob
+    # closing twice is fine
+    context.close()
+
+def test_close_releases_wrappers():
+    import weakref
+    class Test(object): pass
+    obj = Test()
+    ref = weakref.ref(obj)
+    with Context() as context:
+        context.obj = obj
+        assert context.eval('obj') is obj
+    del obj
+    assert ref() is None
+
+def test_context_pool():
+    from v8py import ContextPool
+    def setup(context):
+        context.expose(greeting='hello')
+    pool = ContextPool(size=2, setup=setup)
+    with pool.context() as c1:
+        assert c1.eval('greeting') == 'hello'
+        c1.eval('greeting = "goodbye"; extra = 1')
+    with pool.context() as c2:
+        # the same one, reset
+        assert c2 is c1
+        assert c2.eval('greeting') == 'hello'
+        assert c2.eval('typeof extra') == 'undefined'
+    pool.close()
+    with pytest.raises(ValueError):
+        c1.eval('greeting')
+
+def test_reset():
+    class Thing(object):
+        pass
+    context = Context()
+    context.expose(answer=42)
+    clone = context.clone()
+    thing = Thing()
+    clone.thing = thing
+    clone.expose(other=1)
+    clone.eval('answer = 0; leaked = thing')
+    clone.reset()
+    assert clone.eval('answer') == 42
+    assert clone.eval('typeof other') == 'undefined'
+    assert clone.eval('typeof leaked') == 'undefined'
+    assert clone.memory()['wrapped_objects'] == 0
+    with pytest.raises(ValueError):
+        context.reset()
+
+def test_clone(context):
+    class Greeter(object):
+        def greet(self):
+            return 'hello'
+    def f(): return 'f'
+    context.expose(f, Greeter, answer=42, config={'debug': True})
+    context.eval('f = "changed"')
+
+    clone = context.clone()
+    assert clone is not context
+    assert clone.eval('f()') == 'f'
+    assert clone.eval('f.name') == 'f'
+    assert clone.eval('new Greeter().greet()') == 'hello'
+    assert clone.eval('answer') == 42
+    assert clone.eval('config.debug') is True
+
+    clone.eval('config.debug = false')
+    assert context.clone().eval('config.debug') is True
+
+def test_clone_global():
+    class Global(object):
+        def hello(self):
+            return 'hello'
+    context = Context(Global)
+    context.expose(answer=42)
+    clone = context.clone()
+    assert clone.eval('hello()') == 'hello'
+    assert clone.eval('answer') == 42
+    assert clone.glob is not context.glob
+
+def test_stats():
+    context = Context(stats=True)
+    def callback(s):
+        return s
+    context.callback = callback
+    context.eval('callback("hello")')
+    stats = context.stats(reset=True)
+    assert stats['evals'] == 1
+    assert stats['callbacks'] == 1
+    assert stats['py_from_js'] >= 1
+    assert stats['js_from_py_bytes'] >= 5
+    assert stats['js_time'] >= stats['callback_time'] >= 0
+    assert stats['timeouts'] == 0
+    assert context.stats()['evals'] == 0
+
+    context.timeout = 1
+    context.eval('1')
+    assert context.stats()['timeouts'] == 1
+
+def test_stats_disabled(context):
+    with pytest.raises(ValueError):
+        context.stats()
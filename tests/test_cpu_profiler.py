@@ -0,0 +1,37 @@
+import json
+
+import pytest
+
+from v8py import start_cpu_profiler, stop_cpu_profiler, profile_cpu
+
+BUSY = """
+function busy() {
+    var total = 0;
+    var end = Date.now() + 50;
+    while (Date.now() < end) total++;
+    return total;
+}
+busy();
+"""
+
+def test_cpu_profiler(context):
+    start_cpu_profiler(sample_interval=100)
+    context.eval(BUSY)
+    profile = stop_cpu_profiler()
+    names = [node['callFrame']['functionName'] for node in profile['nodes']]
+    assert 'busy' in names
+    ids = set(node['id'] for node in profile['nodes'])
+    assert all(sample in ids for sample in profile['samples'])
+    assert len(profile['samples']) == len(profile['timeDeltas'])
+
+def test_not_running():
+    with pytest.raises(RuntimeError):
+        stop_cpu_profiler()
+
+def test_profile_cpu(context, tmpdir):
+    path = str(tmpdir.join('test.cpuprofile'))
+    with profile_cpu(path, sample_interval=100) as result:
+        context.eval(BUSY)
+    assert result.profile['nodes']
+    with open(path) as f:
+        assert json.load(f)['nodes'] == result.profile['nodes']
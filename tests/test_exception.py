@@ -1,3 +1,8 @@
+import gc
+import sys
+import traceback
+import weakref
+
 import pytest
 from v8py import Context, JSException
 
@@ -37,6 +42,11 @@ def assert_is_js_frame(frame, script):
     assert frame.f_globals['__name__'].startswith('javascript')
     assert frame.f_globals['__loader__'].get_source(frame.f_globals['__name__']) == script
 
+def js_traceback(exc_info):
+    # on Python 3 the JS frames go on the traceback the first time it's read
+    getattr(exc_info.value, '__traceback__', None)
+    return exc_info.traceback
+
 def test_tracebacks(context, ErrorClass):
     with pytest.raises(ErrorClass) as exc_info:
         context.eval('throw_exception()')
@@ -52,6 +62,14 @@ def test_conservation(context, ErrorClass):
     assert_is_js_frame(exc_info.traceback[1].frame, 'f()')
     assert_is_js_frame(exc_info.traceback[2].frame, 'function f() { throw_exception(); }')
 
+def test_repeated_tracebacks(context, ErrorClass):
+    context.eval('function f() { throw_exception(); }')
+    for i in range(3):
+        with pytest.raises(ErrorClass) as exc_info:
+            context.eval('f()')
+        assert_is_js_frame(exc_info.traceback[2].frame, 'function f() { throw_exception(); }')
+        assert exc_info.traceback[2].frame.f_code.co_name == 'f'
+
 def test_property_error(context, ErrorClass):
     class Test(object):
         @property
@@ -85,3 +103,92 @@ def test_cross_context_exception_value(context):
         context2.eval('call_context()')
     except JSException as e:
         assert e.value['foo'] == 'bar'
+
+def test_plain_exceptions(ErrorClass):
+    context = Context(wrap_exceptions=False)
+    def raise_():
+        raise ErrorClass('boom')
+    context.raise_ = raise_
+    message = context.eval('try { raise_(); } catch (e) { e instanceof Error && e.message }')
+    assert message == ErrorClass.__name__ + ': boom'
+    with pytest.raises(ErrorClass):
+        context.eval('raise_()')
+
+def test_plain_exception_message_formatted_when_read():
+    formatted = []
+    class Boom(Exception):
+        def __str__(self):
+            formatted.append(self)
+            return 'boom'
+    def raise_():
+        raise Boom()
+    context = Context(wrap_exceptions=False)
+    context.raise_ = raise_
+    context.eval('try { raise_(); } catch (e) { this.e = e; }')
+    assert formatted == []
+    assert context.eval('e.message') == 'Boom: boom'
+    assert context.eval('e.message') == 'Boom: boom'
+    assert len(formatted) == 1
+    assert context.eval('Object.keys(e).length') == 0
+    context.eval('e.message = "replaced"')
+    assert context.eval('e.message') == 'replaced'
+
+def test_caught_plain_exception_released():
+    class Boom(Exception):
+        pass
+    raised = []
+    def raise_():
+        exception = Boom()
+        raised.append(weakref.ref(exception))
+        raise exception
+    context = Context(wrap_exceptions=False)
+    context.raise_ = raise_
+    context.eval('try { raise_(); } catch (e) {}')
+    context.gc()
+    gc.collect()
+    assert raised[0]() is None
+
+def test_no_stack_trace():
+    context = Context(stack_trace_limit=0)
+    assert context.stack_trace_limit == 0
+    with pytest.raises(JSException):
+        context.eval('function f() { throw new Error(); } f()')
+
+def test_stack_trace_limit_restored():
+    outer = Context(stack_trace_limit=10)
+    inner = Context(stack_trace_limit=0)
+    outer.run_inner = lambda: inner.eval('1')
+    with pytest.raises(JSException) as exc_info:
+        # back in the outer context after the inner one has run
+        outer.eval('function f() { run_inner(); throw new Error(); } f()')
+    assert len(js_traceback(exc_info)) > 1
+
+def test_js_exception_frames(context):
+    context.eval('function f() { throw new Error(); }')
+    with pytest.raises(JSException) as exc_info:
+        context.eval('f()')
+    assert js_traceback(exc_info)[-1].frame.f_code.co_name == 'f'
+    assert_is_js_frame(js_traceback(exc_info)[-1].frame, 'function f() { throw new Error(); }')
+
+@pytest.mark.skipif(sys.version_info < (3,), reason="no __traceback__ on python 2")
+def test_js_exception_frames_added_once(context):
+    context.eval('function f() { throw new Error(); }')
+    try:
+        context.eval('f()')
+    except JSException as e:
+        exception = e
+    first = len(list(traceback.walk_tb(exception.__traceback__)))
+    assert first > 1
+    assert len(list(traceback.walk_tb(exception.__traceback__))) == first
+    formatted = ''.join(traceback.format_exception(type(exception), exception, exception.__traceback__))
+    assert 'in f' in formatted
+
+def test_stack_trace_on_every_throw():
+    # there's no mode that only captures the first throw: the isolate setting
+    # applies to every exception that leaves JS
+    context = Context(stack_trace_limit=10)
+    context.eval('function f() { throw new Error(); }')
+    for i in range(3):
+        with pytest.raises(JSException) as exc_info:
+            context.eval('f()')
+        assert js_traceback(exc_info)[-1].frame.f_code.co_name == 'f'
@@ -1,3 +1,4 @@
+import sys
 import pytest
 from v8py import JSFunction, JSObject, new
 
@@ -68,3 +69,117 @@ def test_new_keyword(context):
     instance = new(context.glob.MoreThan16Arguments, *args)
     assert instance.data == args
     assert context.glob.MoreThan16Arguments2(*args) == args
+
+def test_function_many_args(context):
+    def args_list(*args):
+        return list(args)
+    context.expose(args_list)
+    assert context.eval('args_list()') == []
+    assert context.eval('args_list(1, "two")') == [1, 'two']
+    assert context.eval('args_list.apply(null, Array.from({length: 40}, (x, i) => i))') == list(range(40))
+
+def test_method_many_args(context):
+    class Test(object):
+        def args_list(self, *args):
+            assert isinstance(self, Test)
+            return list(args)
+    context.expose(Test)
+    context.eval('t = new Test()')
+    assert context.eval('t.args_list()') == []
+    assert context.eval('t.args_list(1, "two")') == [1, 'two']
+    assert context.eval('t.args_list.apply(t, Array.from({length: 40}, (x, i) => i))') == list(range(40))
+
+def test_jsfunction_kwargs(context):
+    f = context.eval('(function (a, options) { return [a, options]; })')
+    assert f(1) == [1, None]
+    assert f(1, b=2, c='three') == [1, {'b': 2, 'c': 'three'}]
+    g = context.eval('(function () { return arguments.length; })')
+    assert g() == 0
+    assert g(*range(40)) == 40
+    assert g(*range(40), option=True) == 41
+
+def test_map(context):
+    double = context.eval('(function (x) { return x * 2; })')
+    assert double.map([1, 2, 3]) == [2, 4, 6]
+    assert double.map(range(5000)) == [x * 2 for x in range(5000)]
+    assert double.map([]) == []
+
+def test_starmap(context):
+    add = context.eval('(function (a, b) { return a + b; })')
+    assert add.starmap([(1, 2), (3, 4)]) == [3, 7]
+    with pytest.raises(TypeError):
+        add.starmap([1, 2])
+
+def test_map_stream(context):
+    double = context.eval('(function (x) { return x * 2; })')
+    results = double.map(range(10), stream=True, chunk_size=3)
+    assert not isinstance(results, list)
+    assert list(results) == [x * 2 for x in range(10)]
+
+def test_map_stream_cycle(context):
+    import gc
+    import weakref
+    identity = context.eval('(function (x) { return x; })')
+    holder = []
+    def items():
+        for i in range(3):
+            yield holder
+    source = items()
+    holder.append(identity.map(source, stream=True))
+    ref = weakref.ref(source)
+    del source, holder
+    gc.collect()
+    assert ref() is None
+
+def test_map_timeout_per_call(context):
+    import time
+    identity = context.eval('(function (x) { return x; })')
+    def slow_items():
+        for i in range(4):
+            time.sleep(0.05)
+            yield i
+    # the sleeping adds up to more than the timeout, but none of it is in JS
+    context.timeout = 0.1
+    assert identity.map(slow_items()) == [0, 1, 2, 3]
+
+def test_map_exception(context):
+    from v8py import JSException
+    f = context.eval('(function (x) { if (x == 2) throw new Error("two"); return x; })')
+    with pytest.raises(JSException):
+        f.map([1, 2, 3])
+
+@pytest.mark.skipif(sys.version_info < (3,), reason="no annotations on python 2")
+def test_annotated_function(context):
+    from typing import List
+    def scale(values, factor):
+        return [v * factor for v in values]
+    scale.__annotations__ = {'values': List[float], 'factor': float, 'return': List[float]}
+    def count(s):
+        return len(s)
+    count.__annotations__ = {'s': str, 'return': int}
+    def lie():
+        return 'not an int'
+    lie.__annotations__ = {'return': int}
+    context.expose(scale, count, lie)
+
+    assert context.eval('scale([1, 2.5], 2)') == [2, 5]
+    assert context.eval('scale(new Float64Array([1, 2]), 3)') == [3, 6]
+    assert context.eval('count("hello")') == 5
+    with pytest.raises(TypeError):
+        context.eval('count(5)')
+    with pytest.raises(TypeError):
+        context.eval('scale(["a"], 2)')
+    with pytest.raises(TypeError):
+        context.eval('lie()')
+
+@pytest.mark.skipif(sys.version_info < (3,), reason="no annotations on python 2")
+def test_annotated_method(context):
+    class Test(object):
+        def add(self, a, b):
+            return a + b
+    Test.add.__annotations__ = {'a': int, 'b': int, 'return': int}
+    context.expose(Test)
+    assert context.eval('new Test().add(1, 2)') == 3
+    assert context.eval('new Test().add(2147483647, 1)') == 2147483648
+    with pytest.raises(TypeError):
+        context.eval('new Test().add(1.5, 2)')
@@ -0,0 +1,59 @@
+import pytest
+
+from v8py import heap_statistics, heap_space_statistics, add_gc_callback, \
+    remove_gc_callback, flush_gc_events
+
+def test_heap_statistics():
+    stats = heap_statistics()
+    assert stats['used_heap_size'] > 0
+    assert stats['total_heap_size'] >= stats['used_heap_size']
+    assert stats['heap_size_limit'] > 0
+    assert stats['external_memory'] >= 0
+
+def test_heap_space_statistics():
+    spaces = heap_space_statistics()
+    assert len(spaces) > 0
+    for name, space in spaces.items():
+        assert space['space_size'] >= space['space_used_size']
+
+def test_context_memory(context):
+    class Test(object): pass
+    context.expose(Test)
+    context.eval('t = new Test()')
+    memory = context.memory()
+    assert memory['estimated_size'] > 0
+    assert memory['wrapped_objects'] >= 1
+    assert memory['scripts'] == 1
+
+def test_gc_callback(context):
+    events = []
+    callback = events.append
+    add_gc_callback(callback)
+    try:
+        context.eval('var garbage = []; for (var i = 0; i < 10000; i++) garbage.push({i: i}); garbage = null')
+        context.gc()
+        assert flush_gc_events() == 0
+    finally:
+        remove_gc_callback(callback)
+    assert events
+    for event in events:
+        assert event['type'] in ('scavenge', 'mark_sweep_compact', 'incremental_marking', 'process_weak_callbacks')
+        assert event['duration'] >= 0
+        assert event['used_heap_size_before'] > 0
+        assert event['dropped_before'] == 0
+    assert any(event['type'] == 'mark_sweep_compact' for event in events)
+
+def test_remove_gc_callback():
+    with pytest.raises(ValueError):
+        remove_gc_callback(lambda event: None)
+
+def test_remove_gc_callback_by_identity():
+    events = []
+    callback = events.append
+    add_gc_callback(callback)
+    try:
+        # equal, but not the one that was added
+        with pytest.raises(ValueError):
+            remove_gc_callback(events.append)
+    finally:
+        remove_gc_callback(callback)
@@ -0,0 +1,37 @@
+import io
+import json
+
+from v8py import take_heap_snapshot, start_sampling_heap_profiler, stop_sampling_heap_profiler
+
+def test_heap_snapshot(context):
+    context.eval('leak = []; for (var i = 0; i < 1000; i++) leak.push({i: i});')
+    f = io.BytesIO()
+    take_heap_snapshot(f)
+    snapshot = json.loads(f.getvalue().decode('ascii'))
+    assert 'snapshot' in snapshot
+    assert len(snapshot['nodes']) > 0
+
+def test_heap_snapshot_filename(context, tmpdir):
+    path = str(tmpdir.join('test.heapsnapshot'))
+    take_heap_snapshot(path)
+    with open(path) as f:
+        assert 'snapshot' in json.load(f)
+
+def walk(node):
+    yield node
+    for child in node['children']:
+        for n in walk(child):
+            yield n
+
+def test_sampling_heap_profiler(context):
+    start_sampling_heap_profiler(sample_interval=128)
+    context.eval("""
+function allocate() {
+    var things = [];
+    for (var i = 0; i < 10000; i++) things.push({i: i});
+    return things;
+}
+allocate();
+""")
+    root = stop_sampling_heap_profiler()
+    assert any(node['name'] == 'allocate' and node['allocations'] for node in walk(root))
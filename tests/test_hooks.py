@@ -0,0 +1,58 @@
+import pytest
+
+from v8py import Script, JSException, set_hook, flush_hook
+
+@pytest.fixture
+def events():
+    events = []
+    set_hook(events.extend, batch_size=1000)
+    yield events
+    set_hook(None)
+
+def test_eval(context, events):
+    script = Script('1', filename='hooked.js')
+    context.eval(script)
+    flush_hook()
+    kinds = [event[0] for event in events]
+    assert kinds == ['eval_start', 'eval_end']
+    assert all(event[1].startswith('hooked.js-') for event in events)
+    assert events[0][3] <= events[1][3]
+
+def test_callback(context, events):
+    def callback():
+        pass
+    context.expose(callback)
+    context.eval(Script('callback()', filename='caller.js'))
+    flush_hook()
+    kinds = [event[0] for event in events]
+    assert kinds == ['eval_start', 'callback_enter', 'callback_exit', 'eval_end']
+    enter = events[1]
+    assert enter[1].startswith('caller.js-')
+    assert enter[2] == 'callback'
+
+def test_exception(context, events):
+    with pytest.raises(JSException):
+        context.eval(Script('throw new Error()', filename='thrower.js'))
+    flush_hook()
+    exceptions = [event for event in events if event[0] == 'exception']
+    assert len(exceptions) == 1
+    assert exceptions[0][1].startswith('thrower.js-')
+    assert exceptions[0][2] == 'JSException'
+
+def test_batches(context):
+    batches = []
+    set_hook(batches.append, batch_size=2)
+    try:
+        context.eval('1')
+        context.eval('2')
+    finally:
+        set_hook(None)
+    assert [len(batch) for batch in batches] == [2, 2]
+
+def test_disabled(context):
+    batches = []
+    set_hook(batches.append)
+    set_hook(None)
+    context.eval('1')
+    flush_hook()
+    assert batches == []
@@ -0,0 +1,31 @@
+import sys
+import pytest
+
+from v8py import idle_notification, memory_pressure_notification, low_memory_notification, \
+        MEMORY_PRESSURE_NONE, MEMORY_PRESSURE_MODERATE, MEMORY_PRESSURE_CRITICAL
+
+def test_idle_notification(context):
+    context.eval('garbage = []; for (var i = 0; i < 10000; i++) garbage.push({}); garbage = null;')
+    assert idle_notification(0.01) in (True, False)
+
+def test_memory_pressure_notification():
+    for level in (MEMORY_PRESSURE_MODERATE, MEMORY_PRESSURE_CRITICAL, MEMORY_PRESSURE_NONE):
+        memory_pressure_notification(level)
+    with pytest.raises(ValueError):
+        memory_pressure_notification(42)
+
+def test_low_memory_notification():
+    low_memory_notification()
+
+@pytest.mark.skipif(sys.version_info < (3, 4), reason="asyncio is not available")
+def test_asyncio_idle_gc():
+    import asyncio
+    from v8py import asyncio_idle_gc
+    loop = asyncio.new_event_loop()
+    collector = asyncio_idle_gc(loop, idle_time=0.05, interval=0.01)
+    calls = []
+    collector.collect = lambda: calls.append(True)
+    loop.run_until_complete(asyncio.sleep(0.1))
+    collector.stop()
+    loop.close()
+    assert calls
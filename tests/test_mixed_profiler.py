@@ -0,0 +1,89 @@
+import time
+
+import pytest
+
+from v8py import start_mixed_profiler, stop_mixed_profiler, profile_mixed
+
+BUSY = """
+function busy() {
+    var total = 0;
+    var end = Date.now() + 50;
+    while (Date.now() < end) total++;
+    return total;
+}
+function calls_python() {
+    return python_busy();
+}
+"""
+
+def python_busy():
+    end = time.time() + 0.05
+    while time.time() < end:
+        pass
+
+def test_mixed_profiler(context):
+    context.expose(python_busy)
+    context.eval(BUSY)
+    start_mixed_profiler(sample_interval=100)
+    context.eval('busy(); calls_python()')
+    samples = stop_mixed_profiler()
+    stacks = [stack.split(';') for stack in samples]
+    assert any(stack[-1].startswith('busy (') for stack in stacks)
+    # Python, then JS, then Python again
+    for stack in stacks:
+        if stack[-1].startswith('python_busy ('):
+            caller = [i for i, frame in enumerate(stack) if frame.startswith('calls_python (')]
+            assert caller and any(frame.startswith('test_mixed_profiler (') for frame in stack[:caller[0]])
+            break
+    else:
+        assert False, 'no samples in python_busy'
+
+def test_not_running():
+    with pytest.raises(RuntimeError):
+        stop_mixed_profiler()
+
+def test_profile_mixed(context, tmpdir):
+    path = str(tmpdir.join('test.folded'))
+    context.eval(BUSY)
+    with profile_mixed(path, sample_interval=100) as result:
+        context.eval('busy()')
+    assert result.samples
+    with open(path) as f:
+        lines = f.read().splitlines()
+    assert len(lines) == len(result.samples)
+    assert all(line.rsplit(' ', 1)[1].isdigit() for line in lines)
+
+class Slow(object):
+    @property
+    def slow_property(self):
+        python_busy()
+        return 1
+
+def test_property_stack(context):
+    context.expose(Slow)
+    context.slow = Slow()
+    context.eval('function reads_property() { return slow.slow_property; }')
+    start_mixed_profiler(sample_interval=100)
+    context.eval('reads_property()')
+    samples = stop_mixed_profiler()
+    for stack in samples:
+        frames = stack.split(';')
+        getter = [i for i, frame in enumerate(frames) if frame.startswith('slow_property (')]
+        if getter:
+            reader = [i for i, frame in enumerate(frames) if frame.startswith('reads_property (')]
+            assert reader and reader[0] < getter[0]
+            break
+    else:
+        assert False, 'no samples in slow_property'
+
+def test_restart_inside_callback(context):
+    def restart():
+        stop_mixed_profiler()
+        start_mixed_profiler(sample_interval=100)
+    context.restart = restart
+    context.python_busy = python_busy
+    context.eval(BUSY)
+    start_mixed_profiler(sample_interval=100)
+    context.eval('restart(); calls_python()')
+    samples = stop_mixed_profiler()
+    assert any(stack.split(';')[-1].startswith('python_busy (') for stack in samples)
@@ -0,0 +1,29 @@
+import os
+import sys
+
+import pytest
+
+from v8py import Script, enable_perf_map, disable_perf_map
+
+pytestmark = pytest.mark.skipif(sys.platform == 'win32', reason='perf is Linux only')
+
+def test_perf_map(context):
+    enable_perf_map()
+    try:
+        script = Script("""
+        function perf_map_function(n) {
+            var total = 0;
+            for (var i = 0; i < n; i++) total += i;
+            return total;
+        }
+        for (var i = 0; i < 1000; i++) perf_map_function(1000);
+        """, filename='perf_test.js')
+        context.eval(script)
+    finally:
+        disable_perf_map()
+    with open('/tmp/perf-%d.map' % os.getpid()) as f:
+        lines = [line.split(' ', 2) for line in f.read().splitlines()]
+    assert all(int(start, 16) and int(size, 16) >= 0 for start, size, name in lines)
+    names = [name for start, size, name in lines if 'perf_map_function' in name]
+    assert names
+    assert all(' perf_test.js-' in name for name in names)
@@ -99,3 +99,111 @@ def test_unsettable(context, Test):
         assert not context.eval('Object.getOwnPropertyDescriptor(test, "unsettable").writable')
         context.eval('test.unsettable = "kappa"')
 
+
+def test_contains(context):
+    class Mapping(object):
+        def __init__(self):
+            self.data = {'present': 1}
+            self.keys_calls = 0
+        def __getitem__(self, key):
+            return self.data[key]
+        def __contains__(self, key):
+            return key in self.data
+        def keys(self):
+            self.keys_calls += 1
+            return list(self.data.keys())
+    mapping = Mapping()
+    context.mapping = mapping
+    assert context.eval('"present" in mapping')
+    assert not context.eval('"absent" in mapping')
+    assert mapping.keys_calls == 0
+
+def test_instance_attribute_shadows_item(context):
+    class Mapping(object):
+        def __getitem__(self, key):
+            return 'item'
+        def keys(self):
+            return ['thing']
+    mapping = Mapping()
+    mapping.thing = 'attribute'
+    context.mapping = mapping
+    # attributes aren't items, even if they're only on the instance
+    assert context.eval('mapping.thing') is None
+
+def test_class_attribute_added_later(context):
+    class Mapping(object):
+        def __getitem__(self, key):
+            return 'item'
+        def keys(self):
+            return ['thing']
+    mapping = Mapping()
+    context.mapping = mapping
+    assert context.eval('mapping.thing') == 'item'
+    Mapping.thing = 'attribute'
+    assert context.eval('mapping.thing') is None
+    del Mapping.thing
+    assert context.eval('mapping.thing') == 'item'
+
+def test_slots(context):
+    class Point(object):
+        __slots__ = ('x', 'y')
+        def __init__(self):
+            self.x = 1
+    point = Point()
+    context.point = point
+    assert context.eval('point.x') == 1
+    # unset slots raise AttributeError like they would in Python
+    with pytest.raises(AttributeError):
+        context.eval('point.y')
+    context.eval('point.y = 2')
+    assert point.y == 2
+
+def test_overridden_property(context):
+    class Base(object):
+        @property
+        def prop(self):
+            return 'base'
+    class Derived(Base):
+        prop = property(lambda self: 'derived')
+    context.base = Base()
+    context.derived = Derived()
+    assert context.eval('base.prop') == 'base'
+    assert context.eval('derived.prop') == 'derived'
+
+def test_sequence(context):
+    class Sequence(object):
+        def __init__(self):
+            self.items = ['a', 'b', 'c']
+        def __getitem__(self, index):
+            return self.items[index]
+        def __setitem__(self, index, value):
+            self.items[index] = value
+        def __len__(self):
+            return len(self.items)
+    sequence = Sequence()
+    context.sequence = sequence
+    assert context.eval('sequence[0]') == 'a'
+    assert context.eval('sequence[3]') is None
+    assert context.eval('1 in sequence')
+    assert not context.eval('3 in sequence')
+    assert list(context.eval('Object.keys(sequence)')) == []
+    assert context.eval('Object.getOwnPropertyNames(sequence).indexOf("2")') >= 0
+    context.eval('sequence[1] = "x"')
+    assert sequence.items == ['a', 'x', 'c']
+
+def test_sequence_bounds_from_index_error(context):
+    class Squares(object):
+        lengths = 0
+        def __getitem__(self, index):
+            if index >= 5:
+                raise IndexError(index)
+            return index * index
+        def __len__(self):
+            Squares.lengths += 1
+            return 5
+    context.squares = Squares()
+    assert context.eval('squares[3]') == 9
+    assert context.eval('squares[5]') is None
+    assert context.eval('4 in squares')
+    assert not context.eval('5 in squares')
+    assert Squares.lengths == 0
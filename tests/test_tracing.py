@@ -0,0 +1,46 @@
+import json
+
+import pytest
+
+from v8py import start_tracing, stop_tracing, trace
+
+def load_events(path):
+    with open(path) as f:
+        return json.load(f)['traceEvents']
+
+def test_tracing(context, tmpdir):
+    path = str(tmpdir.join('trace.json'))
+    context.double = lambda x: x * 2
+    start_tracing(path)
+    context.eval('double(21)')
+    stop_tracing()
+    names = [event['name'] for event in load_events(path)]
+    assert 'Context.eval' in names
+    assert 'Python function' in names
+    # not on by default
+    assert 'py_from_js' not in names
+
+def test_categories(context, tmpdir):
+    path = str(tmpdir.join('trace.json'))
+    with trace(path, categories=['v8py.convert']):
+        context.eval('"kappa"')
+    events = load_events(path)
+    assert events
+    assert all(event['cat'] == 'v8py.convert' for event in events)
+
+def test_long_trace_keeps_the_start(context, tmpdir):
+    path = str(tmpdir.join('trace.json'))
+    context.double = lambda x: x * 2
+    start_tracing(path, ['v8py', 'v8py.convert'])
+    context.eval('"first"')
+    # enough conversions to go around libplatform's ring buffer
+    context.eval('for (var i = 0; i < 30000; i++) double(i)')
+    # the loop's eval was still going when its chunk was written
+    assert stop_tracing() == 1
+    names = [event['name'] for event in load_events(path)]
+    assert names.count('Context.eval') == 2
+    assert names.count('Python function') == 30000
+
+def test_not_running():
+    with pytest.raises(RuntimeError):
+        stop_tracing()
@@ -1,6 +1,9 @@
 from _v8py import *
 
 from .debug import Debugger, DebuggerError
+from .idle import asyncio_idle_gc, gevent_idle_gc
+from .pool import ContextPool
+from .profiler import profile_cpu, profile_mixed, trace
 try:
     from gevent import monkey;monkey.patch_all()
     import geventwebsocket
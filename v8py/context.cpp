@@ -1,6 +1,7 @@
 #include <Python.h>
 #include "v8py.h"
 #include <v8.h>
+#include <vector>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -13,6 +14,8 @@
 #include "convert.h"
 #include "jsobject.h"
 #include "pyclass.h"
+#include "tracing.h"
+#include "hooks.h"
 
 using namespace v8;
 
@@ -21,12 +24,21 @@ PyMethodDef context_methods[] = {
     {"expose", (PyCFunction) context_expose, METH_VARARGS | METH_KEYWORDS, NULL},
     {"expose_module", (PyCFunction) context_expose_module, METH_O, NULL},
     {"gc", (PyCFunction) context_gc, METH_NOARGS, NULL},
+    {"memory", (PyCFunction) context_memory, METH_NOARGS, NULL},
+    {"close", (PyCFunction) context_close, METH_NOARGS, NULL},
+    {"clone", (PyCFunction) context_clone, METH_NOARGS, NULL},
+    {"reset", (PyCFunction) context_reset, METH_NOARGS, NULL},
+    {"stats", (PyCFunction) context_get_stats, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"__enter__", (PyCFunction) context_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction) context_exit, METH_VARARGS, NULL},
     {NULL},
 };
 // Python is wrong. The first entry is not modifiable and should be const char *
 PyGetSetDef context_getset[] = {
     {(char *) "glob", (getter) context_get_global, NULL, NULL, NULL},
     {(char *) "timeout", (getter) context_get_timeout, (setter) context_set_timeout, NULL, NULL},
+    {(char *) "stack_trace_limit", (getter) context_get_stack_trace_limit, (setter) context_set_stack_trace_limit, NULL, NULL},
+    {(char *) "wrap_exceptions", (getter) context_get_wrap_exceptions, (setter) context_set_wrap_exceptions, NULL, NULL},
     {NULL},
 };
 PyMappingMethods context_mapping = {
@@ -50,34 +62,63 @@ int context_type_init() {
     return PyType_Ready(&context_type);
 }
 
+static context_c *context_create(PyTypeObject *type, PyObject *global_arg, double timeout, Local<ObjectTemplate> bindings);
+
+static void context_enable_stats(context_c *self) {
+    self->stats = new context_stats();
+    stats_enabled++;
+}
+
 PyObject *context_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
     IN_V8;
 
     double timeout = 0;
-    static const char *keywords[] = {"global", "timeout", NULL};
+    int stack_trace_limit = DEFAULT_STACK_TRACE_LIMIT;
+    PyObject *wrap_exceptions = Py_True;
+    PyObject *stats = Py_False;
+    static const char *keywords[] = {"global", "timeout", "stack_trace_limit", "wrap_exceptions", "stats", NULL};
 
     PyObject *global = NULL;
-    if (PyArg_ParseTupleAndKeywords(args, kwargs, "|Od", (char **) keywords, &global, &timeout) < 0) {
+    if (PyArg_ParseTupleAndKeywords(args, kwargs, "|OdiOO", (char **) keywords,
+                &global, &timeout, &stack_trace_limit, &wrap_exceptions, &stats) < 0) {
         return NULL;
     }
+    if (stack_trace_limit < 0) {
+        PyErr_SetString(PyExc_ValueError, "stack_trace_limit can't be negative");
+        return NULL;
+    }
+    int wrap = PyObject_IsTrue(wrap_exceptions);
+    if (wrap < 0) return NULL;
+    int collect_stats = PyObject_IsTrue(stats);
+    if (collect_stats < 0) return NULL;
+
+    context_c *self = context_create(type, global, timeout, Local<ObjectTemplate>());
+    PyErr_PROPAGATE(self);
+    self->stack_trace_limit = stack_trace_limit;
+    self->wrap_exceptions = wrap;
+    if (collect_stats) {
+        context_enable_stats(self);
+    }
+    return (PyObject *) self;
+}
+
+// Makes the JS side of the context, with a new global made from global_arg.
+// bindings is used as the global template if there's no Python global.
+static bool context_create_js(context_c *self, Local<ObjectTemplate> bindings) {
+    PyObject *global = self->global_arg;
     if (global != NULL) {
         if (PyType_Check(global) || PyClass_Check(global)) {
             PyObject *no_args = PyTuple_New(0);
-            PyErr_PROPAGATE(no_args);
+            PyErr_PROPAGATE_RET(no_args, false);
             global = PyObject_Call(global, no_args, NULL);
             Py_DECREF(no_args);
-            PyErr_PROPAGATE(global);
+            PyErr_PROPAGATE_RET(global, false);
         } else {
             Py_INCREF(global);
         }
     }
 
-    context_c *self = (context_c *) type->tp_alloc(type, 0);
-    self->has_debugger = false;
-    self->timeout = timeout;
-    PyErr_PROPAGATE(self);
-
-    MaybeLocal<ObjectTemplate> global_template;
+    MaybeLocal<ObjectTemplate> global_template = bindings;
     if (global != NULL) {
         PyObject *global_type;
         if (PyInstance_Check(global)) {
@@ -99,31 +140,118 @@ PyObject *context_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
     context->SetEmbedderData(OBJECT_PROTOTYPE_SLOT, Object::New(isolate)->GetPrototype());
     context->SetEmbedderData(ERROR_PROTOTYPE_SLOT, Exception::Error(String::Empty(isolate)).As<Object>()->GetPrototype());
 
-    PyObject *weakref_module = PyImport_ImportModule("weakref");
-    PyErr_PROPAGATE(weakref_module);
-    PyObject *weak_key_dict = PyObject_GetAttrString(weakref_module, "WeakKeyDictionary");
-    PyErr_PROPAGATE(weak_key_dict);
-    self->js_object_cache = PyObject_CallObject(weak_key_dict, NULL);
-    PyErr_PROPAGATE(self->js_object_cache);
-
-    self->scripts = PySet_New(NULL);
-    PyErr_PROPAGATE(self->scripts);
-
     if (global != NULL) {
         py_class_init_js_object(context->Global()->GetPrototype().As<Object>(), global, context);
     }
+    return true;
+}
 
-    return (PyObject *) self;
+static context_c *context_create(PyTypeObject *type, PyObject *global_arg, double timeout, Local<ObjectTemplate> bindings) {
+    context_c *self = (context_c *) type->tp_alloc(type, 0);
+    PyErr_PROPAGATE(self);
+    self->has_debugger = false;
+    self->closed = false;
+    self->wrappers = NULL;
+    self->timeout = timeout;
+    self->stack_trace_limit = DEFAULT_STACK_TRACE_LIMIT;
+    self->wrap_exceptions = true;
+    // remembered so clone() can make another one the same way
+    Py_XINCREF(global_arg);
+    self->global_arg = global_arg;
+    self->clone_leftovers = NULL;
+    self->clone_source = NULL;
+
+    self->js_object_cache = new std::unordered_map<PyObject *, py_wrapper *>();
+
+    self->scripts = PySet_New(NULL);
+    self->exposed = PyDict_New();
+    if (self->scripts == NULL || self->exposed == NULL || !context_create_js(self, bindings)) {
+        // there's nothing in JS to close yet
+        self->closed = true;
+        Py_DECREF(self);
+        return NULL;
+    }
+    return self;
 }
 
 void context_dealloc(context_c *self) {
+    if (!self->closed) {
+        // the wrappers stay alive until V8 collects them, they just can't
+        // refer back to this context anymore
+        py_class_orphan_wrappers(self);
+    }
+    if (self->stats != NULL) {
+        delete self->stats;
+        stats_enabled--;
+    }
     self->js_context.Reset();
-    Py_DECREF(self->js_object_cache);
-    Py_DECREF(self->scripts);
+    self->clone_template.Reset();
+    Py_XDECREF(self->clone_leftovers);
+    Py_XDECREF(self->clone_source);
+    delete self->js_object_cache;
+    Py_XDECREF(self->scripts);
+    Py_XDECREF(self->exposed);
+    Py_XDECREF(self->global_arg);
     Py_TYPE(self)->tp_free((PyObject *) self);
 }
 
+bool context_check_open(context_c *self) {
+    if (self->closed) {
+        PyErr_SetString(PyExc_ValueError, "context is closed");
+        return false;
+    }
+    return true;
+}
+
+// Throws away the JS side of the context and the wrappers and scripts that
+// belong to it.
+static bool context_dispose_js(context_c *self) {
+    HandleScope hs(isolate);
+    self->js_context.Get(isolate)->DetachGlobal();
+    // this empties the cache too
+    py_class_release_wrappers(self);
+    self->js_context.Reset();
+    isolate->ContextDisposedNotification();
+    // the traceback caches don't know which scripts were this context's
+    frame_cache_clear();
+    return PySet_Clear(self->scripts) == 0;
+}
+
+// Gets rid of everything the context is holding on to right away, instead of
+// whenever V8 gets around to collecting it. JS objects wrapping Python objects
+// that are still reachable from somewhere else end up wrapping None.
+PyObject *context_close(context_c *self) {
+    if (self->closed) {
+        Py_RETURN_NONE;
+    }
+    if (self->has_debugger) {
+        PyErr_SetString(PyExc_ValueError, "cannot close a context with a debugger attached");
+        return NULL;
+    }
+
+    IN_V8;
+    self->closed = true;
+    if (!context_dispose_js(self)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject *context_enter(context_c *self) {
+    if (!context_check_open(self)) return NULL;
+    Py_INCREF(self);
+    return (PyObject *) self;
+}
+
+PyObject *context_exit(context_c *self, PyObject *args) {
+    PyObject *result = context_close(self);
+    PyErr_PROPAGATE(result);
+    Py_DECREF(result);
+    Py_RETURN_FALSE;
+}
+
 PyObject *context_expose(context_c *self, PyObject *args, PyObject *kwargs) {
+    if (!context_check_open(self)) return NULL;
     IN_V8;
     Local<Context> context = self->js_context.Get(isolate);
     Local<Object> global = context->Global();
@@ -144,6 +272,11 @@ PyObject *context_expose(context_c *self, PyObject *args, PyObject *kwargs) {
         PyObject *name = PyObject_GetAttrString(object, "__name__");
         PyErr_PROPAGATE(name);
         global->CreateDataProperty(context, js_from_py(name, context).As<String>(), js_from_py(object, context));
+        if (PyDict_SetItem(self->exposed, name, object) < 0) {
+            Py_DECREF(name);
+            return NULL;
+        }
+        Py_DECREF(name);
     }
     Py_DECREF(args);
 
@@ -153,16 +286,60 @@ PyObject *context_expose(context_c *self, PyObject *args, PyObject *kwargs) {
         while (PyDict_Next(kwargs, &pos, &name, &object)) {
             global->CreateDataProperty(context, js_from_py(name, context).As<String>(), js_from_py(object, context));
         }
+        if (PyDict_Update(self->exposed, kwargs) < 0) {
+            return NULL;
+        }
     }
+    // the bindings changed, so clones need a new template
+    self->clone_template.Reset();
+    Py_CLEAR(self->clone_leftovers);
 
     Py_RETURN_NONE;
 }
 
+// Module members are exposed as accessors on the global that convert the
+// member the first time it's used and then replace themselves with a data
+// property. Most of a big module never gets touched, and converting classes
+// means building templates for them.
+static void lazy_global_getter(Local<Name> js_name, const PropertyCallbackInfo<Value> &info) {
+    HandleScope hs(isolate);
+    Local<Context> context = isolate->GetCurrentContext();
+    context_c *self = (context_c *) context->GetEmbedderData(CONTEXT_OBJECT_SLOT).As<External>()->Value();
+
+    PyObject *name = py_from_js(js_name, context);
+    JS_PROPAGATE_PY(name);
+    // borrowed
+    PyObject *value = PyDict_GetItem(self->exposed, name);
+    Py_DECREF(name);
+    if (value == NULL) {
+        return;
+    }
+    Local<Value> js_value = js_from_py(value, context);
+    if (js_value.IsEmpty()) {
+        js_throw_py();
+        return;
+    }
+    // if replacing the accessor throws, the exception is already on its way
+    Local<Object> global = context->Global();
+    if (global->Delete(context, js_name).IsNothing()) return;
+    if (global->CreateDataProperty(context, js_name, js_value).IsNothing()) return;
+    info.GetReturnValue().Set(js_value);
+}
+
+static void lazy_global_setter(Local<Name> js_name, Local<Value> js_value, const PropertyCallbackInfo<void> &info) {
+    HandleScope hs(isolate);
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Object> global = context->Global();
+    if (global->Delete(context, js_name).IsNothing()) return;
+    if (global->CreateDataProperty(context, js_name, js_value).IsNothing()) return;
+}
+
 PyObject *context_expose_module(context_c *self, PyObject *module) {
     if (!PyModule_Check(module)) {
         PyErr_SetString(PyExc_TypeError, "context_expose_module requires a module");
         return NULL;
     }
+    if (!context_check_open(self)) return NULL;
 
     PyObject *module_all_slow = PyObject_Dir(module);
     PyErr_PROPAGATE(module_all_slow);
@@ -170,28 +347,47 @@ PyObject *context_expose_module(context_c *self, PyObject *module) {
     Py_DECREF(module_all_slow);
     PyErr_PROPAGATE(module_all);
     PyObject *members = PyDict_New();
-    PyErr_PROPAGATE(members);
+    if (members == NULL) {
+        Py_DECREF(module_all);
+        return NULL;
+    }
     for (int i = 0; i < PySequence_Fast_GET_SIZE(module_all); i++) {
         PyObject *name = PySequence_Fast_GET_ITEM(module_all, i);
         if (!PyString_StartsWithString(name, "_")) {
             PyObject *value = PyObject_GetAttr(module, name);
-            if (value == NULL) {
-                Py_DECREF(members);
-                return NULL;
-            }
-            if (PyDict_SetItem(members, name, value) < 0) {
+            if (value == NULL || PyDict_SetItem(members, name, value) < 0) {
+                Py_XDECREF(value);
                 Py_DECREF(members);
+                Py_DECREF(module_all);
                 return NULL;
             }
+            Py_DECREF(value);
         }
     }
+    Py_DECREF(module_all);
+    // the getters look the values up here
+    int result = PyDict_Update(self->exposed, members);
+    if (result < 0) {
+        Py_DECREF(members);
+        return NULL;
+    }
 
-    PyObject *no_args = PyTuple_New(0);
-    PyErr_PROPAGATE(no_args);
-    PyObject *result = context_expose(self, no_args, members);
-    Py_DECREF(no_args);
+    IN_V8;
+    Local<Context> context = self->js_context.Get(isolate);
+    Local<Object> global = context->Global();
+    PyObject *name, *value;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(members, &pos, &name, &value)) {
+        Local<Name> js_name = js_from_py(name, context).As<Name>();
+        // get rid of whatever's there already so the accessor isn't shadowed
+        global->Delete(context, js_name).FromJust();
+        global->SetAccessor(context, js_name, lazy_global_getter, lazy_global_setter).FromJust();
+    }
     Py_DECREF(members);
-    return result;
+    self->clone_template.Reset();
+    Py_CLEAR(self->clone_leftovers);
+
+    Py_RETURN_NONE;
 }
 
 #ifdef _WIN32
@@ -263,14 +459,60 @@ static bool cleanup_timeout(double timeout) {
     return true;
 }
 
+// Capturing stack traces is an isolate setting, so it gets switched to the
+// limit of whichever context is being entered, and switched back on the way
+// out, because JS in one context can call Python that runs JS in another. It
+// only actually changes when going between contexts with different limits.
+static int current_stack_trace_limit = DEFAULT_STACK_TRACE_LIMIT;
+// the limits to go back to, one for each context_setup_timeout that hasn't
+// been cleaned up yet
+static std::vector<int> saved_stack_trace_limits;
+// returns the limit that was there before
+static int apply_stack_trace_limit(int limit) {
+    int previous = current_stack_trace_limit;
+    if (limit == current_stack_trace_limit) {
+        return previous;
+    }
+    isolate->SetCaptureStackTraceForUncaughtExceptions(limit > 0, limit,
+            static_cast<StackTrace::StackTraceOptions>(StackTrace::kOverview | StackTrace::kScriptId));
+    current_stack_trace_limit = limit;
+    return previous;
+}
+
+static bool setup_timeout_counted(context_c *ctx_c, double timeout) {
+    // only the ones that actually arm a timer are counted
+    if (ctx_c->stats == NULL || timeout <= 0) {
+        return setup_timeout(timeout);
+    }
+    double start = platform_time();
+    bool result = setup_timeout(timeout);
+    ctx_c->stats->timeouts++;
+    ctx_c->stats->timeout_setup_time += platform_time() - start;
+    return result;
+}
+
+// this is called on the way into JS, so it's also where the stack trace
+// limit gets applied
 bool context_setup_timeout(Local<Context> context) {
-    return setup_timeout(context_timeout(context));
+    context_c *ctx_c = (context_c *) context->GetEmbedderData(CONTEXT_OBJECT_SLOT).As<External>()->Value();
+    int previous_limit = apply_stack_trace_limit(ctx_c->stack_trace_limit);
+    if (!setup_timeout_counted(ctx_c, ctx_c->timeout)) {
+        apply_stack_trace_limit(previous_limit);
+        return false;
+    }
+    saved_stack_trace_limits.push_back(previous_limit);
+    return true;
 }
 bool context_cleanup_timeout(Local<Context> context) {
+    if (!saved_stack_trace_limits.empty()) {
+        apply_stack_trace_limit(saved_stack_trace_limits.back());
+        saved_stack_trace_limits.pop_back();
+    }
     return cleanup_timeout(context_timeout(context));
 }
 
 PyObject *context_eval(context_c *self, PyObject *args, PyObject *kwargs) {
+    TRACE_EVENT(trace_v8py, "Context.eval");
     PyObject *program;
     PyObject *filename = Py_None;
     double timeout = self->timeout;
@@ -279,6 +521,7 @@ PyObject *context_eval(context_c *self, PyObject *args, PyObject *kwargs) {
     if (PyArg_ParseTupleAndKeywords(args, kwargs, "O|dO", (char **) keywords, &program, &timeout, &filename) < 0) {
         return NULL;
     }
+    if (!context_check_open(self)) return NULL;
     if (!PyString_Check(program) && !PyObject_TypeCheck(program, &script_type)) {
         PyErr_SetString(PyExc_TypeError, "program must be a string or Script");
         return NULL;
@@ -309,9 +552,20 @@ PyObject *context_eval(context_c *self, PyObject *args, PyObject *kwargs) {
     Py_DECREF(program);
     Local<Script> script = unbound_script->BindToCurrentContext();
 
-    if (!setup_timeout(timeout)) return NULL;
+    // before the timeout starts, since a full batch runs the sink right here
+    HOOK_EVENT(HOOK_EVAL_START, py_script->script_name, NULL);
+    int previous_limit = apply_stack_trace_limit(self->stack_trace_limit);
+    if (!setup_timeout_counted(self, timeout)) {
+        apply_stack_trace_limit(previous_limit);
+        return NULL;
+    }
+    STATS_START(context);
     MaybeLocal<Value> result = script->Run(context);
-    if (!cleanup_timeout(timeout)) return NULL;
+    STATS_STOP(evals, js_time);
+    apply_stack_trace_limit(previous_limit);
+    bool cleaned_up = cleanup_timeout(timeout);
+    HOOK_EVENT(HOOK_EVAL_END, py_script->script_name, NULL);
+    if (!cleaned_up) return NULL;
 
     PY_PROPAGATE_JS;
     return py_from_js(result.ToLocalChecked(), context);
@@ -320,29 +574,17 @@ PyObject *context_eval(context_c *self, PyObject *args, PyObject *kwargs) {
 Local<Object> context_get_cached_jsobject(Local<Context> js_context, PyObject *py_object) {
     EscapableHandleScope hs(isolate);
     context_c *self = (context_c *) js_context->GetEmbedderData(CONTEXT_OBJECT_SLOT).As<External>()->Value();
-    if (PyMapping_HasKey(self->js_object_cache, py_object)) {
-        js_object *jsobj = (js_object *) PyObject_GetItem(self->js_object_cache, py_object);
-        if (jsobj == NULL) {
-            // fuck
-            PyErr_WriteUnraisable(PyString_InternFromString("v8py py_class_create_js_object getitem"));
-        }
-        return hs.Escape(jsobj->object.Get(isolate));
+    auto cached = self->js_object_cache->find(py_object);
+    if (cached != self->js_object_cache->end()) {
+        return hs.Escape(cached->second->handle.Get(isolate));
     }
     return Local<Object>();
 }
 
-void context_set_cached_jsobject(Local<Context> js_context, PyObject *py_object, Local<Object> object) {
-    EscapableHandleScope hs(isolate);
+// The wrapper takes itself out when it goes away, see wrapper_unlink
+void context_set_cached_jsobject(Local<Context> js_context, PyObject *py_object, py_wrapper *wrapper) {
     context_c *self = (context_c *) js_context->GetEmbedderData(CONTEXT_OBJECT_SLOT).As<External>()->Value();
-    js_object *jsobj = js_object_weak_new(object, js_context);
-    if (PyObject_SetItem(self->js_object_cache, py_object, (PyObject *) jsobj) < 0) {
-        if (PyErr_ExceptionMatches(PyExc_TypeError)) {
-            // if it's a type error, it's probably "cannot create weak reference" and should be ignored.
-            PyErr_Clear();
-        } else {
-            PyErr_WriteUnraisable(PyString_InternFromString("v8py py_class_create_js_object setitem"));
-        }
-    }
+    (*self->js_object_cache)[py_object] = wrapper;
 }
 
 PyObject *context_get_current(PyObject *shit, PyObject *fuck) {
@@ -364,7 +606,67 @@ int *context_set_timeout(context_c *self, PyObject *value, void *shit) {
     return 0;
 }
 
+// Returns the counters as a dict, and zeroes them if reset is true.
+PyObject *context_get_stats(context_c *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"reset", NULL};
+    PyObject *reset = Py_False;
+    if (PyArg_ParseTupleAndKeywords(args, kwargs, "|O", (char **) keywords, &reset) < 0) {
+        return NULL;
+    }
+    if (self->stats == NULL) {
+        PyErr_SetString(PyExc_ValueError, "context isn't collecting stats, create it with stats=True");
+        return NULL;
+    }
+    int should_reset = PyObject_IsTrue(reset);
+    if (should_reset < 0) return NULL;
+    PyObject *result = py_from_context_stats(self->stats);
+    PyErr_PROPAGATE(result);
+    if (should_reset) {
+        *self->stats = context_stats();
+    }
+    return result;
+}
+
+PyObject *context_get_stack_trace_limit(context_c *self, void *shit) {
+    return PyLong_FromLong(self->stack_trace_limit);
+}
+
+int context_set_stack_trace_limit(context_c *self, PyObject *value, void *shit) {
+    if (value == NULL) {
+        PyErr_SetString(PyExc_TypeError, "can't delete stack_trace_limit");
+        return -1;
+    }
+    long limit = PyLong_AsLong(value);
+    if (limit == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (limit < 0 || limit > INT_MAX) {
+        PyErr_SetString(PyExc_ValueError, "stack_trace_limit out of range");
+        return -1;
+    }
+    self->stack_trace_limit = (int) limit;
+    return 0;
+}
+
+PyObject *context_get_wrap_exceptions(context_c *self, void *shit) {
+    return PyBool_FromLong(self->wrap_exceptions);
+}
+
+int context_set_wrap_exceptions(context_c *self, PyObject *value, void *shit) {
+    if (value == NULL) {
+        PyErr_SetString(PyExc_TypeError, "can't delete wrap_exceptions");
+        return -1;
+    }
+    int wrap = PyObject_IsTrue(value);
+    if (wrap < 0) {
+        return -1;
+    }
+    self->wrap_exceptions = wrap;
+    return 0;
+}
+
 PyObject *context_get_global(context_c *self, void *shit) {
+    if (!context_check_open(self)) return NULL;
     IN_V8;
     Local<Context> context = self->js_context.Get(isolate);
     return py_from_js(context->Global()->GetPrototype(), context);
@@ -409,3 +711,185 @@ PyObject *context_gc(context_c *self) {
     Py_RETURN_NONE;
 }
 
+
+// There's no way to get an exact per-context breakdown out of the heap, so
+// this is V8's estimate of what the context retains plus what we know we're
+// holding on to from the Python side.
+PyObject *context_memory(context_c *self) {
+    if (!context_check_open(self)) return NULL;
+    IN_V8;
+    Local<Context> context = self->js_context.Get(isolate);
+
+    Py_ssize_t wrapped_objects = (Py_ssize_t) self->js_object_cache->size();
+    Py_ssize_t scripts = PySet_GET_SIZE(self->scripts);
+
+    return Py_BuildValue("{s:n,s:n,s:n}",
+            "estimated_size", (Py_ssize_t) context->EstimatedSize(),
+            "wrapped_objects", wrapped_objects,
+            "scripts", scripts);
+}
+
+// Functions, classes and primitives can live on an ObjectTemplate, which V8
+// instantiates along with the context much faster than we could set them one
+// by one. Anything else has to be converted for each clone.
+static Local<Data> template_binding(PyObject *value) {
+    EscapableHandleScope hs(isolate);
+    Local<Context> no_ctx;
+    if (PyFunction_Check(value)) {
+        py_function *templ = (py_function *) py_function_to_template(value);
+        if (templ == NULL) {
+            PyErr_Clear();
+            return Local<Data>();
+        }
+        // the template cache keeps it alive
+        Local<Data> binding = templ->js_template->Get(isolate);
+        Py_DECREF(templ);
+        return hs.Escape(binding);
+    }
+    if (PyType_Check(value) || PyClass_Check(value)) {
+        py_class *templ = (py_class *) py_class_to_template(value);
+        if (templ == NULL) {
+            PyErr_Clear();
+            return Local<Data>();
+        }
+        Local<Data> binding = templ->templ->Get(isolate);
+        Py_DECREF(templ);
+        return hs.Escape(binding);
+    }
+    if (value == Py_None || value == Py_True || value == Py_False || value == null_object ||
+            PyString_Check(value) || PyFloat_Check(value) || PyLong_Check(value)
+#if PY_MAJOR_VERSION < 3
+            || PyInt_Check(value)
+#endif
+            ) {
+        return hs.Escape(Local<Data>(js_from_py(value, no_ctx)));
+    }
+    return Local<Data>();
+}
+
+// The global template clones of self are made from, made the first time it's
+// needed after the bindings change. It's empty if there's a Python global,
+// since that has its own template.
+static bool clone_bindings(context_c *self, Local<ObjectTemplate> *bindings) {
+    if (self->global_arg != NULL) {
+        return true;
+    }
+    if (!self->clone_template.IsEmpty()) {
+        *bindings = self->clone_template.Get(isolate);
+        return true;
+    }
+    PyObject *leftovers = PyList_New(0);
+    PyErr_PROPAGATE_RET(leftovers, false);
+    *bindings = ObjectTemplate::New(isolate);
+    PyObject *name, *object;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(self->exposed, &pos, &name, &object)) {
+        Local<Data> value = template_binding(object);
+        if (!value.IsEmpty()) {
+            (*bindings)->Set(js_from_py(name, Local<Context>()).As<Name>(), value);
+        } else if (PyList_Append(leftovers, name) < 0) {
+            Py_DECREF(leftovers);
+            return false;
+        }
+    }
+    self->clone_template.Reset(isolate, *bindings);
+    Py_XDECREF(self->clone_leftovers);
+    self->clone_leftovers = leftovers;
+    return true;
+}
+
+// Gives clone, whose JS side was just made from bindings, the settings and
+// exposed things of source.
+static bool clone_globals(context_c *source, context_c *clone, Local<ObjectTemplate> bindings) {
+    clone->timeout = source->timeout;
+    clone->stack_trace_limit = source->stack_trace_limit;
+    clone->wrap_exceptions = source->wrap_exceptions;
+    if (PyDict_Update(clone->exposed, source->exposed) < 0) {
+        return false;
+    }
+    if (!bindings.IsEmpty()) {
+        clone->clone_template.Reset(isolate, bindings);
+        Py_INCREF(source->clone_leftovers);
+        Py_XDECREF(clone->clone_leftovers);
+        clone->clone_leftovers = source->clone_leftovers;
+    }
+
+    // whatever didn't make it onto the template, which is everything if
+    // there's a global object and so no template
+    IN_CONTEXT(clone->js_context.Get(isolate));
+    Local<Object> global = context->Global();
+    if (bindings.IsEmpty()) {
+        PyObject *name, *object;
+        Py_ssize_t pos = 0;
+        while (PyDict_Next(source->exposed, &pos, &name, &object)) {
+            global->CreateDataProperty(context, js_from_py(name, context).As<String>(), js_from_py(object, context));
+        }
+    } else {
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(source->clone_leftovers); i++) {
+            PyObject *name = PyList_GET_ITEM(source->clone_leftovers, i);
+            PyObject *object = PyDict_GetItem(source->exposed, name);
+            global->CreateDataProperty(context, js_from_py(name, context).As<String>(), js_from_py(object, context));
+        }
+    }
+    return true;
+}
+
+// Makes a new context with everything that was passed to expose or
+// expose_module on this one. The bindings are put on a global template that's
+// shared between clones, so a clone costs about as much as an empty context.
+// Only exposed things are copied, not anything set from JavaScript.
+PyObject *context_clone(context_c *self) {
+    if (!context_check_open(self)) return NULL;
+    IN_V8;
+
+    Local<ObjectTemplate> bindings;
+    if (!clone_bindings(self, &bindings)) return NULL;
+    context_c *clone = context_create(Py_TYPE(self), self->global_arg, self->timeout, bindings);
+    PyErr_PROPAGATE(clone);
+    if (self->stats != NULL) {
+        context_enable_stats(clone);
+    }
+    // kept for reset()
+    Py_INCREF(self);
+    clone->clone_source = (PyObject *) self;
+    if (!clone_globals(self, clone, bindings)) {
+        Py_DECREF(clone);
+        return NULL;
+    }
+    return (PyObject *) clone;
+}
+
+// Puts a clone back the way clone() would make it now, in place, so the
+// Context object, its wrapper cache and its stats can be used again. Anything
+// done to it since, from JS or by exposing things, is gone, and JS objects
+// wrapping Python objects end up wrapping None like close() leaves them. If
+// this fails, the context is closed.
+PyObject *context_reset(context_c *self) {
+    if (!context_check_open(self)) return NULL;
+    if (self->clone_source == NULL) {
+        PyErr_SetString(PyExc_ValueError, "only a clone can be reset");
+        return NULL;
+    }
+    if (self->has_debugger) {
+        PyErr_SetString(PyExc_ValueError, "cannot reset a context with a debugger attached");
+        return NULL;
+    }
+    context_c *source = (context_c *) self->clone_source;
+    if (!context_check_open(source)) return NULL;
+    IN_V8;
+
+    Local<ObjectTemplate> bindings;
+    if (!clone_bindings(source, &bindings)) return NULL;
+    self->closed = true;
+    if (!context_dispose_js(self)) return NULL;
+    PyDict_Clear(self->exposed);
+    self->clone_template.Reset();
+    Py_CLEAR(self->clone_leftovers);
+    if (!context_create_js(self, bindings)) return NULL;
+    if (!clone_globals(source, self, bindings)) {
+        context_dispose_js(self);
+        return NULL;
+    }
+    self->closed = false;
+    Py_RETURN_NONE;
+}
@@ -3,21 +3,50 @@
 
 #include <Python.h>
 #include <v8.h>
+#include <unordered_map>
 
 #include "pyfunction.h"
+#include "stats.h"
 
 using namespace v8;
 
-typedef struct {
+struct py_wrapper;
+
+typedef struct _context {
     PyObject_HEAD
     Persistent<Context> js_context;
-    PyObject *js_object_cache;
+    // the wrapper for each Python object that has one in this context, so
+    // the same object always comes out as the same JS object
+    std::unordered_map<PyObject *, struct py_wrapper *> *js_object_cache;
     PyObject *scripts;
+    // every Python object wrapped in this context, so they can all be
+    // released when the context is closed
+    struct py_wrapper *wrappers;
+    // everything passed to expose, and the global template made from it for
+    // clone()
+    PyObject *exposed;
+    PyObject *global_arg;
+    Persistent<ObjectTemplate> clone_template;
+    // the exposed names that couldn't go on clone_template, so clones set
+    // them one by one. Made along with the template and shared with clones.
+    PyObject *clone_leftovers;
+    // the context this one was cloned from, for reset()
+    PyObject *clone_source;
     bool has_debugger;
+    bool closed;
     double timeout;
+    // how many frames of JS stack end up in tracebacks, 0 for none
+    int stack_trace_limit;
+    // if this is off, Python exceptions are thrown into JS as plain Errors
+    // instead of wrapped objects, see js_throw_py
+    bool wrap_exceptions;
+    // NULL unless the context was made with stats=True
+    context_stats *stats;
 } context_c;
 int context_type_init();
 
+#define DEFAULT_STACK_TRACE_LIMIT 100
+
 bool context_setup_timeout(Local<Context> context);
 bool context_cleanup_timeout(Local<Context> context);
 
@@ -27,6 +56,14 @@ PyObject *context_eval(context_c *self, PyObject *args, PyObject *kwargs);
 PyObject *context_expose(context_c *self, PyObject *args, PyObject *kwargs);
 PyObject *context_expose_module(context_c *self, PyObject *module);
 PyObject *context_gc(context_c *self);
+PyObject *context_memory(context_c *self);
+PyObject *context_close(context_c *self);
+PyObject *context_clone(context_c *self);
+PyObject *context_reset(context_c *self);
+PyObject *context_enter(context_c *self);
+PyObject *context_exit(context_c *self, PyObject *args);
+PyObject *context_get_stats(context_c *self, PyObject *args, PyObject *kwargs);
+bool context_check_open(context_c *self);
 
 // Embedder data slots
 #define CONTEXT_OBJECT_SLOT 1
@@ -34,13 +71,17 @@ PyObject *context_gc(context_c *self);
 #define ERROR_PROTOTYPE_SLOT 3
 
 Local<Object> context_get_cached_jsobject(Local<Context> context, PyObject *py_object);
-void context_set_cached_jsobject(Local<Context> context, PyObject *py_object, Local<Object> object);
+void context_set_cached_jsobject(Local<Context> context, PyObject *py_object, struct py_wrapper *wrapper);
 
 PyObject *context_get_current(PyObject *shit, PyObject *fuck);
 PyObject *context_get_global(context_c *self, void *shit);
 
 PyObject *context_get_timeout(context_c *self, void *shit);
 int *context_set_timeout(context_c *self, PyObject *value, void *shit);
+PyObject *context_get_stack_trace_limit(context_c *self, void *shit);
+int context_set_stack_trace_limit(context_c *self, PyObject *value, void *shit);
+PyObject *context_get_wrap_exceptions(context_c *self, void *shit);
+int context_set_wrap_exceptions(context_c *self, PyObject *value, void *shit);
 
 PyObject *context_getattro(context_c *self, PyObject *name);
 PyObject *context_getitem(context_c *self, PyObject *name);
@@ -1,15 +1,20 @@
 #include <Python.h>
 #include "v8py.h"
 #include <v8.h>
+#include <cmath>
 
 #include "convert.h"
 #include "pyfunction.h"
 #include "pyclass.h"
 #include "jsobject.h"
 #include "context.h"
+#include "stats.h"
+#include "tracing.h"
 
 PyObject *py_from_js(Local<Value> value, Local<Context> context) {
     IN_V8;
+    TRACE_EVENT(trace_v8py_convert, "py_from_js");
+    STATS_ADD(context, py_from_js, 1);
 
     if (value->IsSymbol()) {
         value = value.As<Symbol>()->Name();
@@ -93,23 +98,8 @@ PyObject *py_from_js(Local<Value> value, Local<Context> context) {
     }
 
     if (value->IsString()) {
-        Local<String> str_value = value.As<String>();
-        size_t bufsize = str_value->Length() * sizeof(uint16_t);
-
-        PyObject *py_value;
-
-        if (bufsize <= STRING_BUFFER_SIZE) {
-            str_value->Write(&string_buffer[0], 0, -1, String::WriteOptions::NO_NULL_TERMINATION);
-            py_value = PyUnicode_DecodeUTF16((const char *) &string_buffer[0], bufsize, NULL, NULL);
-        } else {
-            uint16_t *buf = (uint16_t *) malloc(bufsize);
-            PyErr_PROPAGATE(buf);
-            str_value->Write(buf, 0, -1, String::WriteOptions::NO_NULL_TERMINATION);
-            py_value = PyUnicode_DecodeUTF16((const char *) buf, bufsize, NULL, NULL);
-            free(buf);
-        }
-
-        return py_value;
+        STATS_ADD(context, py_from_js_bytes, value.As<String>()->Length() * sizeof(uint16_t));
+        return py_from_js_string(value.As<String>());
     }
     if (value->IsUint32() || value->IsInt32()) {
         return PyLong_FromLongLong((PY_LONG_LONG) value.As<Integer>()->Value());
@@ -124,8 +114,29 @@ PyObject *py_from_js(Local<Value> value, Local<Context> context) {
     Py_RETURN_NONE;
 }
 
+PyObject *py_from_js_string(Local<String> str_value) {
+    size_t bufsize = str_value->Length() * sizeof(uint16_t);
+
+    PyObject *py_value;
+
+    if (bufsize <= STRING_BUFFER_SIZE) {
+        str_value->Write(&string_buffer[0], 0, -1, String::WriteOptions::NO_NULL_TERMINATION);
+        py_value = PyUnicode_DecodeUTF16((const char *) &string_buffer[0], bufsize, NULL, NULL);
+    } else {
+        uint16_t *buf = (uint16_t *) malloc(bufsize);
+        PyErr_PROPAGATE(buf);
+        str_value->Write(buf, 0, -1, String::WriteOptions::NO_NULL_TERMINATION);
+        py_value = PyUnicode_DecodeUTF16((const char *) buf, bufsize, NULL, NULL);
+        free(buf);
+    }
+
+    return py_value;
+}
+
 Local<Value> js_from_py(PyObject *value, Local<Context> context) {
     ESCAPING_IN_V8;
+    TRACE_EVENT(trace_v8py_convert, "js_from_py");
+    STATS_ADD(context, js_from_py, 1);
 
     if (value == Py_False) {
         return hs.Escape(False(isolate));
@@ -144,6 +155,7 @@ Local<Value> js_from_py(PyObject *value, Local<Context> context) {
     if (PyUnicode_Check(value)) {
         Py_ssize_t len;
         const char *str = PyUnicode_AsUTF8AndSize(value, &len);
+        STATS_ADD(context, js_from_py_bytes, len);
         Local<String> js_value = String::NewFromUtf8(isolate, str, NewStringType::kNormal, len).ToLocalChecked();
         return hs.Escape(js_value);
     }
@@ -151,18 +163,21 @@ Local<Value> js_from_py(PyObject *value, Local<Context> context) {
         char *str;
         Py_ssize_t len;
         PyBytes_AsStringAndSize(value, &str, &len);
+        STATS_ADD(context, js_from_py_bytes, len);
         Local<ArrayBuffer> js_value = ArrayBuffer::New(isolate, len);
-        memcpy(str, js_value->GetContents().Data(), len);
+        memcpy(js_value->GetContents().Data(), str, len);
         return hs.Escape(js_value);
     }
 #else
     if (PyUnicode_Check(value)) {
         PyObject *value_encoded = PyUnicode_EncodeUTF8(PyUnicode_AS_UNICODE(value), PyUnicode_GET_SIZE(value), NULL);
+        STATS_ADD(context, js_from_py_bytes, PyString_GET_SIZE(value_encoded));
         Local<String> js_value = String::NewFromUtf8(isolate, PyString_AS_STRING(value_encoded), NewStringType::kNormal, PyString_GET_SIZE(value_encoded)).ToLocalChecked();
         Py_DECREF(value_encoded);
         return hs.Escape(js_value);
     } 
     if (PyString_Check(value)) {
+        STATS_ADD(context, js_from_py_bytes, PyString_GET_SIZE(value));
         Local<String> js_value = String::NewFromUtf8(isolate, PyString_AS_STRING(value), NewStringType::kNormal, PyString_GET_SIZE(value)).ToLocalChecked();
         return hs.Escape(js_value);
     }
@@ -201,11 +216,14 @@ Local<Value> js_from_py(PyObject *value, Local<Context> context) {
     }
 
     if (PyList_Check(value) || PyTuple_Check(value)) {
-        int length = PySequence_Length(value);
-        Local<Array> array = Array::New(isolate, length);
-        for (int i = 0; i < length; i++) {
-            PyObject *item = PySequence_ITEM(value, i);
-            bool set_worked = array->Set(context, i, js_from_py(item, context)).FromJust();
+        // lists and tuples can be read straight out of their item arrays,
+        // and nothing can be in the way on a fresh array. Converting an item
+        // can run Python code, so the size is checked every time around.
+        Local<Array> array = Array::New(isolate, PySequence_Fast_GET_SIZE(value));
+        for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(value); i++) {
+            PyObject *item = PySequence_Fast_GET_ITEM(value, i);
+            Py_INCREF(item);
+            bool set_worked = array->CreateDataProperty(context, i, js_from_py(item, context)).FromJust();
             assert(set_worked);
             Py_DECREF(item);
         }
@@ -254,6 +272,26 @@ PyObject *pys_from_jss(const FunctionCallbackInfo<Value> &js_args, Local<Context
     return py_args;
 }
 
+int pys_from_jss_array(const FunctionCallbackInfo<Value> &js_args, PyObject **py_args, Local<Context> context,
+        convert_plan *plan) {
+    int argc = js_args.Length();
+    for (int i = 0; i < argc; i++) {
+        int kind = CONVERT_PLAN_ARG(plan, i);
+        if (kind == CONVERT_ANY) {
+            py_args[i] = py_from_js(js_args[i], context);
+        } else {
+            py_args[i] = py_from_js_planned(kind, js_args[i], context);
+        }
+        if (py_args[i] == NULL) {
+            for (int j = 0; j < i; j++) {
+                Py_CLEAR(py_args[j]);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
 // js_args is an out parameter, expected to contain enough space
 void jss_from_pys(PyObject *py_args, Local<Value> *js_args, Local<Context> context) {
     int size = PyTuple_GET_SIZE(py_args);
@@ -262,3 +300,283 @@ void jss_from_pys(PyObject *py_args, Local<Value> *js_args, Local<Context> conte
     }
 }
 
+
+static const char *convert_kind_name(int kind) {
+    switch (kind & ~CONVERT_LIST) {
+        case CONVERT_INT: return kind & CONVERT_LIST ? "list of int" : "int";
+        case CONVERT_FLOAT: return kind & CONVERT_LIST ? "list of float" : "float";
+        case CONVERT_STR: return kind & CONVERT_LIST ? "list of str" : "str";
+        case CONVERT_BYTES: return kind & CONVERT_LIST ? "list of bytes" : "bytes";
+        case CONVERT_BOOL: return kind & CONVERT_LIST ? "list of bool" : "bool";
+    }
+    return "anything";
+}
+
+#if PY_MAJOR_VERSION >= 3
+static int convert_kind_from_name(PyObject *name) {
+    static const struct {
+        const char *name;
+        int kind;
+    } names[] = {
+        {"int", CONVERT_INT}, {"float", CONVERT_FLOAT}, {"str", CONVERT_STR},
+        {"bytes", CONVERT_BYTES}, {"bool", CONVERT_BOOL},
+        {"list[int]", CONVERT_LIST | CONVERT_INT}, {"List[int]", CONVERT_LIST | CONVERT_INT},
+        {"list[float]", CONVERT_LIST | CONVERT_FLOAT}, {"List[float]", CONVERT_LIST | CONVERT_FLOAT},
+        {"list[str]", CONVERT_LIST | CONVERT_STR}, {"List[str]", CONVERT_LIST | CONVERT_STR},
+        {"list[bool]", CONVERT_LIST | CONVERT_BOOL}, {"List[bool]", CONVERT_LIST | CONVERT_BOOL},
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (PyUnicode_CompareWithASCIIString(name, names[i].name) == 0) {
+            return names[i].kind;
+        }
+    }
+    return CONVERT_ANY;
+}
+
+static int convert_kind_from_annotation(PyObject *annotation) {
+    if (annotation == (PyObject *) &PyLong_Type) return CONVERT_INT;
+    if (annotation == (PyObject *) &PyFloat_Type) return CONVERT_FLOAT;
+    if (annotation == (PyObject *) &PyUnicode_Type) return CONVERT_STR;
+    if (annotation == (PyObject *) &PyBytes_Type) return CONVERT_BYTES;
+    if (annotation == (PyObject *) &PyBool_Type) return CONVERT_BOOL;
+    // from __future__ import annotations
+    if (PyUnicode_Check(annotation)) return convert_kind_from_name(annotation);
+
+    // list[float] and typing.List[float] both have these
+    int kind = CONVERT_ANY;
+    PyObject *origin = PyObject_GetAttrString(annotation, "__origin__");
+    PyObject *args = PyObject_GetAttrString(annotation, "__args__");
+    PyErr_Clear();
+    if (origin == (PyObject *) &PyList_Type && args != NULL && PyTuple_Check(args) && PyTuple_GET_SIZE(args) == 1) {
+        int item_kind = convert_kind_from_annotation(PyTuple_GET_ITEM(args, 0));
+        if (item_kind != CONVERT_ANY && !(item_kind & CONVERT_LIST)) {
+            kind = CONVERT_LIST | item_kind;
+        }
+    }
+    Py_XDECREF(origin);
+    Py_XDECREF(args);
+    return kind;
+}
+#endif
+
+convert_plan *convert_plan_new(PyObject *function, bool is_method) {
+#if PY_MAJOR_VERSION >= 3
+    if (!PyFunction_Check(function)) return NULL;
+    PyObject *annotations = PyFunction_GetAnnotations(function); // borrowed
+    if (annotations == NULL || !PyDict_Check(annotations) || PyDict_Size(annotations) == 0) {
+        return NULL;
+    }
+    PyCodeObject *code = (PyCodeObject *) PyFunction_GetCode(function); // borrowed
+    PyObject *varnames = PyObject_GetAttrString((PyObject *) code, "co_varnames");
+    if (varnames == NULL || !PyTuple_Check(varnames)) {
+        Py_XDECREF(varnames);
+        PyErr_Clear();
+        return NULL;
+    }
+    int first = is_method ? 1 : 0;
+    int nargs = code->co_argcount - first;
+    if (nargs < 0) nargs = 0;
+
+    convert_plan *plan = new convert_plan();
+    plan->nargs = nargs;
+    plan->args = new int[nargs > 0 ? nargs : 1];
+    bool worth_it = false;
+    for (int i = 0; i < nargs; i++) {
+        PyObject *annotation = PyDict_GetItem(annotations, PyTuple_GET_ITEM(varnames, i + first));
+        plan->args[i] = annotation == NULL ? CONVERT_ANY : convert_kind_from_annotation(annotation);
+        worth_it |= plan->args[i] != CONVERT_ANY;
+    }
+    Py_DECREF(varnames);
+    PyObject *ret = PyDict_GetItemString(annotations, "return");
+    plan->ret = ret == NULL ? CONVERT_ANY : convert_kind_from_annotation(ret);
+    worth_it |= plan->ret != CONVERT_ANY;
+
+    if (!worth_it) {
+        convert_plan_free(plan);
+        return NULL;
+    }
+    return plan;
+#else
+    // no annotations on python 2
+    return NULL;
+#endif
+}
+
+void convert_plan_free(convert_plan *plan) {
+    if (plan == NULL) return;
+    delete[] plan->args;
+    delete plan;
+}
+
+static PyObject *planned_type_error(int kind) {
+    PyErr_Format(PyExc_TypeError, "expected %s", convert_kind_name(kind));
+    return NULL;
+}
+
+PyObject *py_from_js_planned(int kind, Local<Value> value, Local<Context> context) {
+    if (kind & CONVERT_LIST) {
+        int item_kind = kind & ~CONVERT_LIST;
+        if (item_kind == CONVERT_FLOAT && value->IsFloat64Array()) {
+            // no need to go through the elements one by one
+            Local<Float64Array> typed = value.As<Float64Array>();
+            size_t length = typed->Length();
+            const double *data = (const double *) ((const char *) typed->Buffer()->GetContents().Data() + typed->ByteOffset());
+            PyObject *list = PyList_New(length);
+            PyErr_PROPAGATE(list);
+            for (size_t i = 0; i < length; i++) {
+                PyObject *item = PyFloat_FromDouble(data[i]);
+                if (item == NULL) {
+                    Py_DECREF(list);
+                    return NULL;
+                }
+                PyList_SET_ITEM(list, i, item);
+            }
+            return list;
+        }
+        if (!value->IsArray()) {
+            return planned_type_error(kind);
+        }
+        Local<Array> array = value.As<Array>();
+        uint32_t length = array->Length();
+        PyObject *list = PyList_New(length);
+        PyErr_PROPAGATE(list);
+        for (uint32_t i = 0; i < length; i++) {
+            PyObject *item = py_from_js_planned(item_kind, array->Get(context, i).ToLocalChecked(), context);
+            if (item == NULL) {
+                Py_DECREF(list);
+                return NULL;
+            }
+            PyList_SET_ITEM(list, i, item);
+        }
+        return list;
+    }
+
+    // CONVERT_ANY gets counted by py_from_js
+    if (kind != CONVERT_ANY) {
+        STATS_ADD(context, py_from_js, 1);
+    }
+    switch (kind) {
+        case CONVERT_INT:
+            if (value->IsInt32()) {
+                return PyLong_FromLong(value.As<Int32>()->Value());
+            }
+            if (value->IsNumber()) {
+                double number = value.As<Number>()->Value();
+                if (number == std::floor(number) && !std::isinf(number)) {
+                    return PyLong_FromDouble(number);
+                }
+            }
+            break;
+        case CONVERT_FLOAT:
+            if (value->IsNumber()) {
+                return PyFloat_FromDouble(value.As<Number>()->Value());
+            }
+            break;
+        case CONVERT_STR:
+            if (value->IsString()) {
+                return py_from_js_string(value.As<String>());
+            }
+            break;
+        case CONVERT_BYTES:
+            if (value->IsArrayBuffer()) {
+                ArrayBuffer::Contents contents = value.As<ArrayBuffer>()->GetContents();
+                return PyBytes_FromStringAndSize((const char *) contents.Data(), contents.ByteLength());
+            }
+            if (value->IsArrayBufferView()) {
+                Local<ArrayBufferView> view = value.As<ArrayBufferView>();
+                ArrayBuffer::Contents contents = view->Buffer()->GetContents();
+                return PyBytes_FromStringAndSize((const char *) contents.Data() + view->ByteOffset(), view->ByteLength());
+            }
+            break;
+        case CONVERT_BOOL:
+            if (value->IsBoolean()) {
+                PyObject *result = value.As<Boolean>()->Value() ? Py_True : Py_False;
+                Py_INCREF(result);
+                return result;
+            }
+            break;
+        default:
+            return py_from_js(value, context);
+    }
+    return planned_type_error(kind);
+}
+
+Local<Value> js_from_py_planned(int kind, PyObject *value, Local<Context> context) {
+    EscapableHandleScope hs(isolate);
+    if (kind & CONVERT_LIST) {
+        int item_kind = kind & ~CONVERT_LIST;
+        if (!PyList_Check(value) && !PyTuple_Check(value)) {
+            planned_type_error(kind);
+            return Local<Value>();
+        }
+        Py_ssize_t length = PySequence_Fast_GET_SIZE(value);
+        PyObject **items = PySequence_Fast_ITEMS(value);
+        Local<Array> array = Array::New(isolate, (int) length);
+        for (Py_ssize_t i = 0; i < length; i++) {
+            Local<Value> item = js_from_py_planned(item_kind, items[i], context);
+            if (item.IsEmpty()) {
+                return Local<Value>();
+            }
+            // Set would go looking for setters on Array.prototype
+            if (array->CreateDataProperty(context, (uint32_t) i, item).IsNothing()) {
+                PyErr_SetString(PyExc_RuntimeError, "couldn't fill in a converted list");
+                return Local<Value>();
+            }
+        }
+        return hs.Escape(array);
+    }
+
+    // CONVERT_ANY gets counted by js_from_py
+    if (kind != CONVERT_ANY) {
+        STATS_ADD(context, js_from_py, 1);
+    }
+    switch (kind) {
+        case CONVERT_INT:
+            if (PyLong_Check(value)) {
+                int overflow;
+                long long number = PyLong_AsLongLongAndOverflow(value, &overflow);
+                if (overflow == 0 && number >= INT32_MIN && number <= INT32_MAX) {
+                    return hs.Escape(Integer::New(isolate, (int32_t) number));
+                }
+                double big = PyLong_AsDouble(value);
+                if (big == -1 && PyErr_Occurred()) {
+                    return Local<Value>();
+                }
+                return hs.Escape(Number::New(isolate, big));
+            }
+            break;
+        case CONVERT_FLOAT:
+            if (PyFloat_Check(value)) {
+                return hs.Escape(Number::New(isolate, PyFloat_AS_DOUBLE(value)));
+            }
+            if (PyLong_Check(value)) {
+                double number = PyLong_AsDouble(value);
+                if (number == -1 && PyErr_Occurred()) {
+                    return Local<Value>();
+                }
+                return hs.Escape(Number::New(isolate, number));
+            }
+            break;
+        case CONVERT_STR:
+            if (PyUnicode_Check(value)) {
+                return hs.Escape(js_from_py(value, context));
+            }
+            break;
+        case CONVERT_BYTES:
+            if (PyBytes_Check(value)) {
+                Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, PyBytes_GET_SIZE(value));
+                memcpy(buffer->GetContents().Data(), PyBytes_AS_STRING(value), PyBytes_GET_SIZE(value));
+                return hs.Escape(buffer);
+            }
+            break;
+        case CONVERT_BOOL:
+            if (PyBool_Check(value)) {
+                return hs.Escape(Boolean::New(isolate, value == Py_True));
+            }
+            break;
+        default:
+            return hs.Escape(js_from_py(value, context));
+    }
+    planned_type_error(kind);
+    return Local<Value>();
+}
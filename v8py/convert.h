@@ -5,13 +5,53 @@
 #include <v8.h>
 
 PyObject *py_from_js(Local<Value> js_value, Local<Context> context);
+PyObject *py_from_js_string(Local<String> js_value);
 // If any Python exceptions are thrown in the process, they get swallowed.
 // Because they're probably never going to be too serious. Only like
 // MemoryError.
 Local<Value> js_from_py(PyObject *py_value, Local<Context> context);
 
 PyObject *pys_from_jss(const FunctionCallbackInfo<Value> &js_args, Local<Context> context);
+// py_args is an out parameter, expected to contain enough space. On failure,
+// anything already converted is released, everything is set to NULL, and -1
+// is returned.
+struct convert_plan;
+int pys_from_jss_array(const FunctionCallbackInfo<Value> &js_args, PyObject **py_args, Local<Context> context,
+        struct convert_plan *plan = NULL);
+// calls with at most this many arguments don't allocate an argument array
+#define ARGS_STACK_SIZE 16
 // js_args is an out parameter, expected to contain enough space
 void jss_from_pys(PyObject *py_args, Local<Value> *js_args, Local<Context> context);
 
+
+// A converter plan is worked out once from a function's annotations, so each
+// call can do straight-line conversions for the declared types instead of
+// going through py_from_js and js_from_py. Anything unannotated is
+// CONVERT_ANY and gets the generic conversion.
+enum convert_kind {
+    CONVERT_ANY = 0,
+    CONVERT_INT,
+    CONVERT_FLOAT,
+    CONVERT_STR,
+    CONVERT_BYTES,
+    CONVERT_BOOL,
+    // or'd with one of the above, for list[...]
+    CONVERT_LIST = 0x10,
+};
+typedef struct convert_plan {
+    int nargs;
+    int *args;
+    int ret;
+} convert_plan;
+#define CONVERT_PLAN_ARG(plan, i) \
+    ((plan) != NULL && (i) < (plan)->nargs ? (plan)->args[i] : CONVERT_ANY)
+
+// Returns NULL without an exception if there's nothing worth planning.
+convert_plan *convert_plan_new(PyObject *function, bool is_method);
+// takes NULL
+void convert_plan_free(convert_plan *plan);
+// These raise TypeError if the value isn't of the planned type.
+PyObject *py_from_js_planned(int kind, Local<Value> js_value, Local<Context> context);
+Local<Value> js_from_py_planned(int kind, PyObject *py_value, Local<Context> context);
+
 #endif
@@ -0,0 +1,153 @@
+#include <Python.h>
+#include "v8py.h"
+#include <v8.h>
+#include <v8-profiler.h>
+
+#include "convert.h"
+#include "cpuprofiler.h"
+
+using namespace v8;
+
+// There's only one isolate, so there's only ever one profile going.
+static bool cpu_profiling = false;
+#define PROFILE_TITLE "v8py"
+
+// sample_interval is in microseconds
+PyObject *start_cpu_profiler(PyObject *shit, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"sample_interval", NULL};
+    int sample_interval = 1000;
+    if (PyArg_ParseTupleAndKeywords(args, kwargs, "|i", (char **) keywords, &sample_interval) < 0) {
+        return NULL;
+    }
+    if (sample_interval <= 0) {
+        PyErr_SetString(PyExc_ValueError, "sample_interval must be positive");
+        return NULL;
+    }
+    if (cpu_profiling) {
+        PyErr_SetString(PyExc_RuntimeError, "cpu profiler is already running");
+        return NULL;
+    }
+
+    IN_V8;
+    CpuProfiler *profiler = isolate->GetCpuProfiler();
+    // this only works before profiling starts
+    profiler->SetSamplingInterval(sample_interval);
+    profiler->StartProfiling(JSTR(PROFILE_TITLE), true);
+    cpu_profiling = true;
+    Py_RETURN_NONE;
+}
+
+// The nodes go into one flat list that refers to children by id, which is
+// how .cpuprofile files have them.
+static int add_profile_node(PyObject *nodes, const CpuProfileNode *node) {
+    int children_count = node->GetChildrenCount();
+    PyObject *children = PyList_New(children_count);
+    PyErr_PROPAGATE_(children);
+    for (int i = 0; i < children_count; i++) {
+        PyObject *child_id = PyLong_FromUnsignedLong(node->GetChild(i)->GetNodeId());
+        if (child_id == NULL) {
+            Py_DECREF(children);
+            return -1;
+        }
+        PyList_SET_ITEM(children, i, child_id);
+    }
+
+    PyObject *function_name = py_from_js_string(node->GetFunctionName());
+    PyObject *url = py_from_js_string(node->GetScriptResourceName());
+    PyObject *script_id = PyUnicode_FromFormat("%d", node->GetScriptId());
+    if (function_name == NULL || url == NULL || script_id == NULL) {
+        Py_XDECREF(function_name);
+        Py_XDECREF(url);
+        Py_XDECREF(script_id);
+        Py_DECREF(children);
+        return -1;
+    }
+    // V8 counts lines and columns from 1, the file format counts from 0.
+    // N steals the references.
+    PyObject *py_node = Py_BuildValue("{s:k,s:{s:N,s:N,s:N,s:i,s:i},s:I,s:N}",
+            "id", (unsigned long) node->GetNodeId(),
+            "callFrame",
+                "functionName", function_name,
+                "scriptId", script_id,
+                "url", url,
+                "lineNumber", node->GetLineNumber() - 1,
+                "columnNumber", node->GetColumnNumber() - 1,
+            "hitCount", node->GetHitCount(),
+            "children", children);
+    PyErr_PROPAGATE_(py_node);
+    int result = PyList_Append(nodes, py_node);
+    Py_DECREF(py_node);
+    if (result < 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < children_count; i++) {
+        if (add_profile_node(nodes, node->GetChild(i)) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static PyObject *py_from_cpu_profile(CpuProfile *profile) {
+    PyObject *nodes = PyList_New(0);
+    PyErr_PROPAGATE(nodes);
+    if (add_profile_node(nodes, profile->GetTopDownRoot()) < 0) {
+        Py_DECREF(nodes);
+        return NULL;
+    }
+
+    int samples_count = profile->GetSamplesCount();
+    PyObject *samples = PyList_New(samples_count);
+    PyObject *time_deltas = PyList_New(samples_count);
+    if (samples == NULL || time_deltas == NULL) {
+        goto fail;
+    }
+    {
+        int64_t last_timestamp = profile->GetStartTime();
+        for (int i = 0; i < samples_count; i++) {
+            PyObject *sample = PyLong_FromUnsignedLong(profile->GetSample(i)->GetNodeId());
+            if (sample == NULL) goto fail;
+            PyList_SET_ITEM(samples, i, sample);
+            int64_t timestamp = profile->GetSampleTimestamp(i);
+            PyObject *delta = PyLong_FromLongLong(timestamp - last_timestamp);
+            if (delta == NULL) goto fail;
+            PyList_SET_ITEM(time_deltas, i, delta);
+            last_timestamp = timestamp;
+        }
+    }
+
+    // times are in microseconds
+    return Py_BuildValue("{s:N,s:L,s:L,s:N,s:N}",
+            "nodes", nodes,
+            "startTime", (PY_LONG_LONG) profile->GetStartTime(),
+            "endTime", (PY_LONG_LONG) profile->GetEndTime(),
+            "samples", samples,
+            "timeDeltas", time_deltas);
+
+fail:
+    Py_DECREF(nodes);
+    Py_XDECREF(samples);
+    Py_XDECREF(time_deltas);
+    return NULL;
+}
+
+// Returns the profile as a dict in the same shape as a .cpuprofile file, so
+// json.dump-ing it gives something Chrome's devtools can load.
+PyObject *stop_cpu_profiler(PyObject *shit, PyObject *noargs) {
+    if (!cpu_profiling) {
+        PyErr_SetString(PyExc_RuntimeError, "cpu profiler is not running");
+        return NULL;
+    }
+
+    IN_V8;
+    CpuProfile *profile = isolate->GetCpuProfiler()->StopProfiling(JSTR(PROFILE_TITLE));
+    cpu_profiling = false;
+    if (profile == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "cpu profiler didn't return a profile");
+        return NULL;
+    }
+    PyObject *result = py_from_cpu_profile(profile);
+    profile->Delete();
+    return result;
+}
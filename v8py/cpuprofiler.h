@@ -0,0 +1,13 @@
+#ifndef CPUPROFILER_H
+#define CPUPROFILER_H
+
+#include <Python.h>
+#include <v8.h>
+#include <v8-profiler.h>
+
+using namespace v8;
+
+PyObject *start_cpu_profiler(PyObject *shit, PyObject *args, PyObject *kwargs);
+PyObject *stop_cpu_profiler(PyObject *shit, PyObject *noargs);
+
+#endif
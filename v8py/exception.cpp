@@ -1,13 +1,19 @@
 #include <Python.h>
 #include "v8py.h"
 #include <v8.h>
+#include <unordered_map>
 
 #include "script.h"
+#include "context.h"
 #include "pyclass.h"
 #include "convert.h"
+#include "hooks.h"
 
 PyGetSetDef js_exception_getsets[] = {
     {"value", (getter) js_exception_get_value, NULL, NULL},
+#if PY_MAJOR_VERSION >= 3
+    {"__traceback__", (getter) js_exception_get_traceback, (setter) js_exception_set_traceback, NULL},
+#endif
     {NULL},
 };
 PyTypeObject js_exception_type = {
@@ -76,7 +82,313 @@ extern "C" {
     PyAPI_FUNC(struct _frame *) PyFrame_New(PyThreadState *, PyCodeObject *, PyObject *, PyObject *);
 }
 
+// The code object and globals for a frame only depend on where it is, and
+// making them is most of the cost of turning a JS stack into a traceback, so
+// they're made once per location. Frames themselves are cheap. Closing a
+// context empties the caches, so they don't hang on to its scripts.
+struct frame_location {
+    int script_id;
+    int line;
+    int column;
+    bool operator==(const frame_location &other) const {
+        return script_id == other.script_id && line == other.line && column == other.column;
+    }
+};
+struct frame_location_hash {
+    size_t operator()(const frame_location &location) const {
+        return ((size_t) location.script_id * 31 + location.line) * 31 + location.column;
+    }
+};
+static std::unordered_map<frame_location, PyCodeObject *, frame_location_hash> frame_codes;
+static std::unordered_map<int, PyObject *> frame_globals;
+// every eval of new source is a new script, so this can't be allowed to grow
+// forever
+#define FRAME_CACHE_LIMIT 4096
+
+void frame_cache_clear() {
+    for (auto &entry : frame_codes) {
+        Py_DECREF(entry.second);
+    }
+    frame_codes.clear();
+    for (auto &entry : frame_globals) {
+        Py_DECREF(entry.second);
+    }
+    frame_globals.clear();
+}
+
+// borrowed reference
+static PyObject *frame_globals_for(Local<StackFrame> stack_frame) {
+    int script_id = stack_frame->GetScriptId();
+    auto cached = frame_globals.find(script_id);
+    if (cached != frame_globals.end()) {
+        return cached->second;
+    }
+    if (frame_globals.size() >= FRAME_CACHE_LIMIT) {
+        frame_cache_clear();
+    }
+
+    PyObject *script_name = construct_script_name(stack_frame->GetScriptName(), script_id);
+    PyErr_PROPAGATE(script_name);
+    PyObject *globals = PyDict_New();
+    if (globals == NULL) {
+        Py_DECREF(script_name);
+        return NULL;
+    }
+    // set the loader and name
+    if (PyDict_SetItemString(globals, "__loader__", script_loader) < 0 ||
+            PyDict_SetItemString(globals, "__name__", script_name) < 0) {
+        Py_DECREF(script_name);
+        Py_DECREF(globals);
+        return NULL;
+    }
+    Py_DECREF(script_name);
+    frame_globals[script_id] = globals;
+    return globals;
+}
+
+// borrowed reference
+static PyCodeObject *frame_code_for(Local<StackFrame> stack_frame, PyObject *globals) {
+    frame_location location = {stack_frame->GetScriptId(), stack_frame->GetLineNumber(), stack_frame->GetColumn()};
+    auto cached = frame_codes.find(location);
+    if (cached != frame_codes.end()) {
+        return cached->second;
+    }
+    if (frame_codes.size() >= FRAME_CACHE_LIMIT) {
+        // this takes the globals with it, so hang on to them
+        Py_INCREF(globals);
+        frame_cache_clear();
+        frame_globals[location.script_id] = globals;
+    }
+
+    // Not documented, but arguments to PyCode_NewEmpty go through
+    // PyUnicode_FromString, so they're UTF-8 encoded
+    Local<String> js_func_name = stack_frame->GetFunctionName();
+    // whenever I remember the terrible bug introduced by not having
+    // space for the null terminator, I get chills
+    char *func_name = (char *) malloc(js_func_name->Utf8Length() + 1);
+    if (func_name == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    js_func_name->WriteUtf8(func_name);
+
+    PyObject *script_name_string = PyUnicode_AsUTF8String(PyDict_GetItemString(globals, "__name__"));
+    if (script_name_string == NULL) {
+        free(func_name);
+        return NULL;
+    }
+#if PY_MAJOR_VERSION >= 3
+    // I can't use the macro form because it uses assert and I
+    // redefined assert to not be an expression
+    char *script_name = PyBytes_AsString(script_name_string);
+#else
+    char *script_name = PyString_AS_STRING(script_name_string);
+#endif
+
+    PyCodeObject *code = PyCode_NewEmpty(script_name, func_name, location.line);
+    Py_DECREF(script_name_string);
+    free(func_name);
+    if (code == NULL) return NULL;
+    frame_codes[location] = code;
+    return code;
+}
+
+// Puts a frame on the traceback of the exception being raised for each frame
+// of the JS stack. Each one goes in front of the last, so innermost first.
+static bool add_js_frames(Local<StackTrace> stack_trace) {
+    for (int i = 0; i < stack_trace->GetFrameCount(); i++) {
+        Local<StackFrame> stack_frame = stack_trace->GetFrame(i);
+        PyObject *globals = frame_globals_for(stack_frame);
+        if (globals == NULL) return false;
+        PyCodeObject *code = frame_code_for(stack_frame, globals);
+        if (code == NULL) return false;
+
+        struct _frame *frame = PyFrame_New(PyThreadState_GET(), code, globals, NULL);
+        if (frame == NULL) return false;
+        PyTraceBack_Here(frame);
+        Py_DECREF(frame);
+    }
+    return true;
+}
+
+#if PY_MAJOR_VERSION >= 3
+// A JSException only keeps the Message with the stack V8 captured. The frames
+// go on the end of its traceback the first time __traceback__ is read, which
+// is what printing or formatting it does, so exceptions that just get caught
+// never pay for them.
+static int js_exception_build_frames(js_exception *self) {
+    if (self->message.IsEmpty()) return 0;
+    IN_V8;
+    Local<StackTrace> stack_trace = self->message.Get(isolate)->GetStackTrace();
+    if (stack_trace.IsEmpty() || stack_trace->GetFrameCount() == 0) return 0;
+
+    // PyTraceBack_Here only adds to the exception being raised, so the JS
+    // frames get built on a stand-in and moved over
+    PyObject *exc_type, *exc_value, *exc_traceback;
+    PyErr_Fetch(&exc_type, &exc_value, &exc_traceback);
+    PyErr_SetNone(PyExc_Exception);
+    bool built = add_js_frames(stack_trace);
+    PyObject *js_type, *js_value, *js_traceback;
+    PyErr_Fetch(&js_type, &js_value, &js_traceback);
+    if (!built) {
+        Py_XDECREF(exc_type);
+        Py_XDECREF(exc_value);
+        Py_XDECREF(exc_traceback);
+        PyErr_Restore(js_type, js_value, js_traceback);
+        return -1;
+    }
+    Py_XDECREF(js_type);
+    Py_XDECREF(js_value);
+    PyErr_Restore(exc_type, exc_value, exc_traceback);
+    if (js_traceback == NULL) return 0;
+
+    // The Python frames it went through are already on the traceback, and
+    // whatever sys.exc_info() has shares the same tail, so the JS frames show
+    // up there too
+    if (self->base.traceback == NULL) {
+        self->base.traceback = js_traceback;
+        return 0;
+    }
+    PyTracebackObject *last = (PyTracebackObject *) self->base.traceback;
+    while (last->tb_next != NULL) {
+        last = last->tb_next;
+    }
+    last->tb_next = (PyTracebackObject *) js_traceback;
+    return 0;
+}
+
+PyObject *js_exception_get_traceback(js_exception *self, void *shit) {
+    if (!self->frames_built) {
+        self->frames_built = true;
+        if (js_exception_build_frames(self) < 0) return NULL;
+    }
+    if (self->base.traceback == NULL) {
+        Py_RETURN_NONE;
+    }
+    Py_INCREF(self->base.traceback);
+    return self->base.traceback;
+}
+
+int js_exception_set_traceback(js_exception *self, PyObject *value, void *shit) {
+    if (value == NULL) {
+        PyErr_SetString(PyExc_TypeError, "__traceback__ may not be deleted");
+        return -1;
+    }
+    // a traceback set from Python is the whole story
+    self->frames_built = true;
+    return PyException_SetTraceback((PyObject *) self, value);
+}
+#endif
+
+// A Python exception thrown into JS as a plain Error rides along on the Error
+// under a private key. If the Error comes back out, the Python exception comes
+// out instead. If JS catches it and lets it go, the Python exception goes when
+// the Error gets collected.
+struct plain_exception {
+    Persistent<Object> handle;
+    PyObject *type;
+    PyObject *value;
+    PyObject *traceback;
+};
+
+static Local<Private> plain_exception_key() {
+    return Private::ForApi(isolate, JSTR("v8py::plain_exception"));
+}
+
+static void plain_exception_weak_callback(const WeakCallbackInfo<plain_exception> &info) {
+    plain_exception *record = info.GetParameter();
+    Py_XDECREF(record->type);
+    Py_XDECREF(record->value);
+    Py_XDECREF(record->traceback);
+    record->handle.Reset();
+    delete record;
+}
+
+static plain_exception *plain_exception_for(Local<Object> object) {
+    Local<Value> record_value;
+    if (!object->GetPrivate(object->CreationContext(), plain_exception_key()).ToLocal(&record_value) ||
+            !record_value->IsExternal()) {
+        return NULL;
+    }
+    return (plain_exception *) record_value.As<External>()->Value();
+}
+
+static bool restore_plain_exception(Local<Value> js_exc) {
+    if (!js_exc->IsObject()) {
+        return false;
+    }
+    plain_exception *record = plain_exception_for(js_exc.As<Object>());
+    if (record == NULL) {
+        return false;
+    }
+    // the Error still has it, in case it gets thrown again
+    Py_XINCREF(record->type);
+    Py_XINCREF(record->value);
+    Py_XINCREF(record->traceback);
+    PyErr_Restore(record->type, record->value, record->traceback);
+    return true;
+}
+
+// The message is 'TypeName: str(exception)', which means calling into Python,
+// and JS that catches these usually never looks at it. So the Error gets an
+// accessor that works the message out the first time it's read and then
+// replaces itself with a plain message property.
+static void plain_exception_message_getter(Local<Name> js_name, const PropertyCallbackInfo<Value> &info) {
+    HandleScope hs(isolate);
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Object> holder = info.Holder();
+    plain_exception *record = plain_exception_for(holder);
+    if (record == NULL) {
+        return;
+    }
+
+    Local<Value> js_message;
+    PyObject *type_name = PyObject_GetAttrString(record->type, "__name__");
+    PyObject *message = type_name == NULL ? NULL : PyUnicode_FromFormat("%S: %S", type_name, record->value);
+    Py_XDECREF(type_name);
+    if (message != NULL) {
+        js_message = js_from_py(message, context);
+        Py_DECREF(message);
+    }
+    if (js_message.IsEmpty()) {
+        PyErr_Clear();
+        js_message = String::Empty(isolate);
+    }
+    // if replacing the accessor throws, the exception is already on its way
+    if (holder->Delete(context, js_name).IsNothing()) return;
+    if (holder->DefineOwnProperty(context, js_name, js_message, DontEnum).IsNothing()) return;
+    info.GetReturnValue().Set(js_message);
+}
+
+static void plain_exception_message_setter(Local<Name> js_name, Local<Value> js_value, const PropertyCallbackInfo<void> &info) {
+    HandleScope hs(isolate);
+    Local<Context> context = isolate->GetCurrentContext();
+    Local<Object> holder = info.Holder();
+    if (holder->Delete(context, js_name).IsNothing()) return;
+    if (holder->DefineOwnProperty(context, js_name, js_value, DontEnum).IsNothing()) return;
+}
+
+// Throws the exception as a plain Error, which is all JS gets to see of it.
+// Steals the references.
+static void js_throw_py_plain(Local<Context> context, PyObject *exc_type, PyObject *exc_value, PyObject *exc_traceback) {
+    Local<Object> exception = Exception::Error(String::Empty(isolate)).As<Object>();
+    plain_exception *record = new plain_exception;
+    record->type = exc_type;
+    record->value = exc_value;
+    record->traceback = exc_traceback;
+    record->handle.Reset(isolate, exception);
+    record->handle.SetWeak(record, plain_exception_weak_callback, WeakCallbackType::kFinalizer);
+    exception->SetPrivate(context, plain_exception_key(), External::New(isolate, record)).FromJust();
+    Local<String> message_name = JSTR("message");
+    // get rid of the empty message so the accessor isn't shadowed
+    exception->Delete(context, message_name).FromJust();
+    exception->SetAccessor(context, message_name, plain_exception_message_getter, plain_exception_message_setter,
+            MaybeLocal<Value>(), DEFAULT, DontEnum).FromJust();
+    isolate->ThrowException(exception);
+}
+
 void py_throw_js(Local<Value> js_exc, Local<Message> js_message) {
+    bool lazy_frames = false;
     if (js_exc->IsObject() && js_exc.As<Object>()->InternalFieldCount() == OBJECT_INTERNAL_FIELDS) {
         Local<Object> exc_object = js_exc.As<Object>();
         PyObject *exc_type = (PyObject *) exc_object->GetInternalField(2).As<External>()->Value();
@@ -87,72 +399,52 @@ void py_throw_js(Local<Value> js_exc, Local<Message> js_message) {
         } else {
             PyErr_Restore(exc_type, exc_value, exc_traceback);
         }
+    } else if (restore_plain_exception(js_exc)) {
+        // it was a Python exception that JS didn't catch
     } else {
         PyObject *exception = js_exception_new(js_exc, js_message);
         if (exception == NULL) {
             return;
         }
         PyErr_SetObject((PyObject *) &js_exception_type, exception);
-    }
-
-    Local<StackTrace> stack_trace = js_message->GetStackTrace();
-    for (int i = 0; i < stack_trace->GetFrameCount(); i++) {
-        Local<StackFrame> stack_frame = stack_trace->GetFrame(i);
-
-        // Not documented, but arguments to PyCode_NewEmpty go through
-        // PyUnicode_FromString, so they're UTF-8 encoded
-        Local<String> js_func_name = stack_frame->GetFunctionName();
-        // whenever I remember the terrible bug introduced by not having
-        // space for the null terminator, I get chills
-        char *func_name = (char *) malloc(js_func_name->Utf8Length() + 1);
-        if (func_name == NULL) {
-            // fuck it, plenty of shit is probably already breaking anyway
-            func_name = (char *) "help i'm trapped in a computer that's out of memory";
-        } else {
-            js_func_name->WriteUtf8(func_name);
-        }
-
-        PyObject *script_name_unicode = construct_script_name(stack_frame->GetScriptName(), stack_frame->GetScriptId());
-        if (script_name_unicode == NULL) return;
-        PyObject *script_name_string = PyUnicode_AsUTF8String(script_name_unicode);
-        if (script_name_string == NULL) return;
 #if PY_MAJOR_VERSION >= 3
-        // I can't use the macro form because it uses assert and I
-        // redefined assert to not be an expression
-        char *script_name = PyBytes_AsString(script_name_string);
-#else
-        char *script_name = PyString_AS_STRING(script_name_string);
+        lazy_frames = true;
 #endif
-
-        PyCodeObject *code = PyCode_NewEmpty(script_name, func_name, stack_frame->GetLineNumber());
-        Py_DECREF(script_name_string);
-        free(func_name);
-        if (code == NULL) return;
-
-        PyObject *globals = PyDict_New();
-        if (globals == NULL) return;
-        // set the loader and name
-        PyDict_SetItemString(globals, "__loader__", script_loader);
-        PyDict_SetItemString(globals, "__name__", script_name_unicode);
-        Py_DECREF(script_name_unicode);
-
-        struct _frame *frame = PyFrame_New(PyThreadState_GET(), code, globals, NULL);
-        if (frame == NULL) return;
-
-        Py_DECREF(globals);
-        Py_DECREF(code);
-        PyTraceBack_Here(frame);
     }
+    if (hook_enabled) {
+        PyObject *script_name = NULL;
+        if (!js_message.IsEmpty()) {
+            PyObject *exc_type, *exc_value, *exc_traceback;
+            PyErr_Fetch(&exc_type, &exc_value, &exc_traceback);
+            script_name = construct_script_name(js_message->GetScriptResourceName(),
+                    js_message->GetScriptOrigin().ScriptID()->Value());
+            PyErr_Clear();
+            PyErr_Restore(exc_type, exc_value, exc_traceback);
+        }
+        hook_record_exception(script_name);
+        Py_XDECREF(script_name);
+    }
+
+    // there's no stack trace if the context doesn't capture them
+    if (lazy_frames || js_message.IsEmpty()) return;
+    Local<StackTrace> stack_trace = js_message->GetStackTrace();
+    if (stack_trace.IsEmpty()) return;
+    add_js_frames(stack_trace);
 }
 
 void js_throw_py() {
     Local<Context> context = isolate->GetCurrentContext();
+    HOOK_EXCEPTION(NULL);
     PyObject *exc_type, *exc_value, *exc_traceback;
     PyErr_Fetch(&exc_type, &exc_value, &exc_traceback);
     PyErr_NormalizeException(&exc_type, &exc_value, &exc_traceback);
+    context_c *ctx_c = (context_c *) context->GetEmbedderData(CONTEXT_OBJECT_SLOT).As<External>()->Value();
     Local<Object> exception;
     if (PyObject_TypeCheck(exc_value, &js_exception_type)) {
         exception = ((js_exception *) exc_value)->exception.Get(isolate).As<Object>();
+    } else if (!ctx_c->wrap_exceptions) {
+        js_throw_py_plain(context, exc_type, exc_value, exc_traceback);
+        return;
     } else {
         exception = js_from_py(exc_value, context).As<Object>();
         exception->SetInternalField(2, External::New(isolate, exc_type));
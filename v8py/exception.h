@@ -10,6 +10,8 @@ typedef struct {
     PyBaseExceptionObject base;
     Persistent<Value> exception;
     Persistent<Message> message;
+    // whether the JS stack in message has been put on the traceback yet
+    bool frames_built;
 } js_exception;
 extern PyTypeObject js_exception_type;
 int js_exception_type_init();
@@ -20,6 +22,12 @@ PyObject *js_exception_new(Local<Value> exception, Local<Message> message);
 void js_exception_dealloc(js_exception *self);
 PyObject *js_exception_str(js_exception *self);
 PyObject *js_exception_get_value(js_exception *self, void *shit);
+#if PY_MAJOR_VERSION >= 3
+PyObject *js_exception_get_traceback(js_exception *self, void *shit);
+int js_exception_set_traceback(js_exception *self, PyObject *value, void *shit);
+#endif
+
+void frame_cache_clear();
 
 void py_throw_js(Local<Value> js_exc, Local<Message> js_message);
 #define JS_TRY TryCatch tc(isolate);
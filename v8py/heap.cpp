@@ -0,0 +1,300 @@
+#include <Python.h>
+#include "v8py.h"
+#include <v8.h>
+#include <vector>
+
+#include "heap.h"
+
+using namespace v8;
+
+// Statistics come back as plain dicts so they can be handed straight to
+// whatever is scraping them without having to know about V8.
+
+static int dict_set_size(PyObject *dict, const char *key, size_t value) {
+    PyObject *py_value = PyLong_FromSize_t(value);
+    PyErr_PROPAGATE_(py_value);
+    int result = PyDict_SetItemString(dict, key, py_value);
+    Py_DECREF(py_value);
+    return result;
+}
+
+PyObject *heap_statistics(PyObject *shit, PyObject *noargs) {
+    IN_V8;
+    HeapStatistics stats;
+    isolate->GetHeapStatistics(&stats);
+    // passing 0 doesn't change anything, it just returns the current amount
+    int64_t external_memory = isolate->AdjustAmountOfExternalAllocatedMemory(0);
+
+    PyObject *dict = PyDict_New();
+    PyErr_PROPAGATE(dict);
+#define SET_STAT(key, value) \
+    if (dict_set_size(dict, key, value) < 0) { \
+        Py_DECREF(dict); \
+        return NULL; \
+    }
+    SET_STAT("total_heap_size", stats.total_heap_size());
+    SET_STAT("total_heap_size_executable", stats.total_heap_size_executable());
+    SET_STAT("total_physical_size", stats.total_physical_size());
+    SET_STAT("total_available_size", stats.total_available_size());
+    SET_STAT("used_heap_size", stats.used_heap_size());
+    SET_STAT("heap_size_limit", stats.heap_size_limit());
+    SET_STAT("malloced_memory", stats.malloced_memory());
+    SET_STAT("peak_malloced_memory", stats.peak_malloced_memory());
+    SET_STAT("external_memory", external_memory < 0 ? 0 : (size_t) external_memory);
+#undef SET_STAT
+    return dict;
+}
+
+PyObject *heap_space_statistics(PyObject *shit, PyObject *noargs) {
+    IN_V8;
+    PyObject *spaces = PyDict_New();
+    PyErr_PROPAGATE(spaces);
+
+    size_t num_spaces = isolate->NumberOfHeapSpaces();
+    for (size_t i = 0; i < num_spaces; i++) {
+        HeapSpaceStatistics stats;
+        if (!isolate->GetHeapSpaceStatistics(&stats, i)) {
+            continue;
+        }
+        PyObject *space = PyDict_New();
+        if (space == NULL) {
+            Py_DECREF(spaces);
+            return NULL;
+        }
+        if (dict_set_size(space, "space_size", stats.space_size()) < 0 ||
+                dict_set_size(space, "space_used_size", stats.space_used_size()) < 0 ||
+                dict_set_size(space, "space_available_size", stats.space_available_size()) < 0 ||
+                dict_set_size(space, "physical_space_size", stats.physical_space_size()) < 0 ||
+                PyDict_SetItemString(spaces, stats.space_name(), space) < 0) {
+            Py_DECREF(space);
+            Py_DECREF(spaces);
+            return NULL;
+        }
+        Py_DECREF(space);
+    }
+    return spaces;
+}
+
+// These let the host tell V8 when it's a good time to collect, so the
+// collections don't end up in the middle of something latency sensitive.
+
+// Returns True if V8 has nothing left to clean up, so there's no point in
+// giving it more idle time until more JavaScript has run.
+PyObject *idle_notification(PyObject *shit, PyObject *idle_time) {
+    double seconds = PyFloat_AsDouble(idle_time);
+    if (seconds == -1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    IN_V8;
+    // the deadline has to be on the platform's clock
+    double deadline = platform_time() + seconds;
+    return PyBool_FromLong(isolate->IdleNotificationDeadline(deadline));
+}
+
+PyObject *memory_pressure_notification(PyObject *shit, PyObject *level) {
+    long py_level = PyLong_AsLong(level);
+    if (py_level == -1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    if (py_level < (long) MemoryPressureLevel::kNone || py_level > (long) MemoryPressureLevel::kCritical) {
+        PyErr_SetString(PyExc_ValueError, "level must be one of the MEMORY_PRESSURE_* constants");
+        return NULL;
+    }
+    IN_V8;
+    isolate->MemoryPressureNotification(static_cast<MemoryPressureLevel>(py_level));
+    Py_RETURN_NONE;
+}
+
+PyObject *low_memory_notification(PyObject *shit, PyObject *noargs) {
+    IN_V8;
+    isolate->LowMemoryNotification();
+    Py_RETURN_NONE;
+}
+
+// GC callbacks. V8's prologue and epilogue hooks run in the middle of the GC,
+// where running Python could run finalizers that touch the heap, so all they
+// do is write down what happened. The Python callbacks get the events later,
+// from a pending call, or whenever flush_gc_events is called.
+
+struct gc_event {
+    GCType type;
+    GCCallbackFlags flags;
+    double start;
+    double duration;
+    size_t used_before;
+    size_t used_after;
+    // how many events were dropped right before this one
+    size_t dropped_before;
+};
+
+// Python callables, each called with a dict for every event
+static PyObject *gc_callbacks = NULL;
+// started GCs, as a stack because a GC can kick off another one
+static std::vector<gc_event> gcs_started;
+static std::vector<gc_event> gc_events;
+// if nobody flushes, this keeps the buffer from growing forever
+#define GC_EVENT_LIMIT 1024
+// since the last flush_gc_events, and since the last event that was kept
+static size_t gc_events_dropped = 0;
+static size_t gc_events_skipped = 0;
+static bool gc_flush_queued = false;
+
+static size_t used_heap_size() {
+    HeapStatistics stats;
+    isolate->GetHeapStatistics(&stats);
+    return stats.used_heap_size();
+}
+
+static int gc_flush_pending_call(void *data);
+
+static void gc_prologue(Isolate *isolate, GCType type, GCCallbackFlags flags) {
+    gc_event event = {type, flags, platform_time(), 0, used_heap_size(), 0, 0};
+    gcs_started.push_back(event);
+}
+
+static void gc_epilogue(Isolate *isolate, GCType type, GCCallbackFlags flags) {
+    if (gcs_started.empty()) {
+        // the callbacks were added in the middle of this one
+        return;
+    }
+    gc_event event = gcs_started.back();
+    gcs_started.pop_back();
+    event.duration = platform_time() - event.start;
+    event.used_after = used_heap_size();
+    if (gc_events.size() < GC_EVENT_LIMIT) {
+        event.dropped_before = gc_events_skipped;
+        gc_events_skipped = 0;
+        gc_events.push_back(event);
+    } else {
+        gc_events_dropped++;
+        gc_events_skipped++;
+    }
+    if (!gc_flush_queued && Py_AddPendingCall(gc_flush_pending_call, NULL) == 0) {
+        gc_flush_queued = true;
+    }
+}
+
+static const char *gc_type_name(GCType type) {
+    switch (type) {
+        case kGCTypeScavenge: return "scavenge";
+        case kGCTypeMarkSweepCompact: return "mark_sweep_compact";
+        case kGCTypeIncrementalMarking: return "incremental_marking";
+        case kGCTypeProcessWeakCallbacks: return "process_weak_callbacks";
+        default: return "unknown";
+    }
+}
+
+static PyObject *py_from_gc_event(gc_event &event) {
+    // start and duration are in seconds, start on the same clock as
+    // idle_notification's deadlines. dropped_before says how many GCs went
+    // unrecorded in between this one and the one before it because nobody
+    // was flushing.
+    return Py_BuildValue("{s:s,s:O,s:d,s:d,s:n,s:n,s:n}",
+            "type", gc_type_name(event.type),
+            "forced", event.flags & kGCCallbackFlagForced ? Py_True : Py_False,
+            "start", event.start,
+            "duration", event.duration,
+            "used_heap_size_before", (Py_ssize_t) event.used_before,
+            "used_heap_size_after", (Py_ssize_t) event.used_after,
+            "dropped_before", (Py_ssize_t) event.dropped_before);
+}
+
+// Hands every buffered event to every callback. Exceptions from the callbacks
+// are reported and otherwise ignored, since there's nobody to raise them to.
+static void gc_flush() {
+    // callbacks can cause GCs, which add to the buffer, so take it first
+    std::vector<gc_event> events;
+    events.swap(gc_events);
+    if (gc_callbacks == NULL) return;
+    // and they can add or remove callbacks
+    PyObject *callbacks = PyList_GetSlice(gc_callbacks, 0, PyList_GET_SIZE(gc_callbacks));
+    if (callbacks == NULL) {
+        PyErr_WriteUnraisable(gc_callbacks);
+        return;
+    }
+    for (gc_event &event : events) {
+        PyObject *py_event = py_from_gc_event(event);
+        if (py_event == NULL) {
+            PyErr_WriteUnraisable(gc_callbacks);
+            continue;
+        }
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(callbacks); i++) {
+            PyObject *callback = PyList_GET_ITEM(callbacks, i);
+            PyObject *result = PyObject_CallFunctionObjArgs(callback, py_event, NULL);
+            if (result == NULL) {
+                PyErr_WriteUnraisable(callback);
+            }
+            Py_XDECREF(result);
+        }
+        Py_DECREF(py_event);
+    }
+    Py_DECREF(callbacks);
+}
+
+static int gc_flush_pending_call(void *data) {
+    gc_flush_queued = false;
+    // this can run in the middle of anything
+    PyObject *exc_type, *exc_value, *exc_traceback;
+    PyErr_Fetch(&exc_type, &exc_value, &exc_traceback);
+    gc_flush();
+    PyErr_Restore(exc_type, exc_value, exc_traceback);
+    return 0;
+}
+
+// V8 only gets the hooks while there's a callback, so GCs cost nothing extra
+// the rest of the time.
+PyObject *add_gc_callback(PyObject *shit, PyObject *callback) {
+    if (!PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+    if (gc_callbacks == NULL) {
+        gc_callbacks = PyList_New(0);
+        PyErr_PROPAGATE(gc_callbacks);
+    }
+    if (PyList_GET_SIZE(gc_callbacks) == 0) {
+        IN_V8;
+        isolate->AddGCPrologueCallback(gc_prologue);
+        isolate->AddGCEpilogueCallback(gc_epilogue);
+    }
+    if (PyList_Append(gc_callbacks, callback) < 0) return NULL;
+    Py_RETURN_NONE;
+}
+
+PyObject *remove_gc_callback(PyObject *shit, PyObject *callback) {
+    Py_ssize_t index = -1;
+    if (gc_callbacks != NULL) {
+        // by identity, because bound methods compare equal when their
+        // objects do, so two different callbacks could take each other out.
+        // Keep a reference to the one that was added.
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(gc_callbacks); i++) {
+            if (PyList_GET_ITEM(gc_callbacks, i) == callback) {
+                index = i;
+                break;
+            }
+        }
+    }
+    if (index == -1) {
+        PyErr_SetString(PyExc_ValueError, "callback was never added");
+        return NULL;
+    }
+    if (PySequence_DelItem(gc_callbacks, index) < 0) return NULL;
+    if (PyList_GET_SIZE(gc_callbacks) == 0) {
+        IN_V8;
+        isolate->RemoveGCPrologueCallback(gc_prologue);
+        isolate->RemoveGCEpilogueCallback(gc_epilogue);
+        gcs_started.clear();
+        gc_events.clear();
+        gc_events_skipped = 0;
+    }
+    Py_RETURN_NONE;
+}
+
+// Delivers the buffered events now instead of waiting for the pending call,
+// and returns how many were dropped because the buffer was full.
+PyObject *flush_gc_events(PyObject *shit, PyObject *noargs) {
+    gc_flush();
+    size_t dropped = gc_events_dropped;
+    gc_events_dropped = 0;
+    return PyLong_FromSize_t(dropped);
+}
@@ -0,0 +1,20 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <Python.h>
+#include <v8.h>
+
+using namespace v8;
+
+PyObject *heap_statistics(PyObject *shit, PyObject *noargs);
+PyObject *heap_space_statistics(PyObject *shit, PyObject *noargs);
+
+PyObject *idle_notification(PyObject *shit, PyObject *idle_time);
+PyObject *memory_pressure_notification(PyObject *shit, PyObject *level);
+PyObject *low_memory_notification(PyObject *shit, PyObject *noargs);
+
+PyObject *add_gc_callback(PyObject *shit, PyObject *callback);
+PyObject *remove_gc_callback(PyObject *shit, PyObject *callback);
+PyObject *flush_gc_events(PyObject *shit, PyObject *noargs);
+
+#endif
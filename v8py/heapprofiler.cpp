@@ -0,0 +1,161 @@
+#include <Python.h>
+#include "v8py.h"
+#include <v8.h>
+#include <v8-profiler.h>
+
+#include "convert.h"
+#include "script.h"
+#include "heapprofiler.h"
+
+using namespace v8;
+
+OutputStream::WriteResult PyFileOutputStream::WriteAsciiChunk(char *data, int size) {
+    PyObject *chunk = PyBytes_FromStringAndSize(data, size);
+    if (chunk == NULL) {
+        failed_ = true;
+        return kAbort;
+    }
+    PyObject *result = PyObject_CallFunctionObjArgs(write_, chunk, NULL);
+    Py_DECREF(chunk);
+    if (result == NULL) {
+        failed_ = true;
+        return kAbort;
+    }
+    Py_DECREF(result);
+    return kContinue;
+}
+
+// file can be a filename or anything with a write method that takes bytes
+PyObject *take_heap_snapshot(PyObject *shit, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"file", NULL};
+    PyObject *file;
+    if (PyArg_ParseTupleAndKeywords(args, kwargs, "O", (char **) keywords, &file) < 0) {
+        return NULL;
+    }
+
+    bool opened = false;
+    if (PyString_Check(file)) {
+        PyObject *io_module = PyImport_ImportModule("io");
+        PyErr_PROPAGATE(io_module);
+        file = PyObject_CallMethod(io_module, (char *) "open", (char *) "Os", file, "wb");
+        Py_DECREF(io_module);
+        PyErr_PROPAGATE(file);
+        opened = true;
+    } else {
+        Py_INCREF(file);
+    }
+    PyObject *write = PyObject_GetAttrString(file, "write");
+    if (write == NULL) {
+        Py_DECREF(file);
+        return NULL;
+    }
+
+    PyFileOutputStream stream(write);
+    {
+        IN_V8;
+        HeapProfiler *profiler = isolate->GetHeapProfiler();
+        const HeapSnapshot *snapshot = profiler->TakeHeapSnapshot();
+        snapshot->Serialize(&stream, HeapSnapshot::kJSON);
+        const_cast<HeapSnapshot *>(snapshot)->Delete();
+    }
+    Py_DECREF(write);
+
+    if (opened) {
+        // close() can't be called with the write's exception still set, and
+        // that one is the one to report
+        PyObject *exc_type, *exc_value, *exc_traceback;
+        if (stream.failed()) {
+            PyErr_Fetch(&exc_type, &exc_value, &exc_traceback);
+        }
+        PyObject *result = PyObject_CallMethod(file, (char *) "close", NULL);
+        Py_XDECREF(result);
+        if (stream.failed()) {
+            PyErr_Clear();
+            PyErr_Restore(exc_type, exc_value, exc_traceback);
+        } else if (result == NULL) {
+            Py_DECREF(file);
+            return NULL;
+        }
+    }
+    Py_DECREF(file);
+    if (stream.failed()) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject *start_sampling_heap_profiler(PyObject *shit, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"sample_interval", "stack_depth", NULL};
+    unsigned PY_LONG_LONG sample_interval = 512 * 1024;
+    int stack_depth = 16;
+    if (PyArg_ParseTupleAndKeywords(args, kwargs, "|Ki", (char **) keywords, &sample_interval, &stack_depth) < 0) {
+        return NULL;
+    }
+
+    IN_V8;
+    if (!isolate->GetHeapProfiler()->StartSamplingHeapProfiler(sample_interval, stack_depth)) {
+        PyErr_SetString(PyExc_RuntimeError, "sampling heap profiler is already running");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *py_from_allocation_node(AllocationProfile::Node *node) {
+    Local<Context> no_ctx;
+    PyObject *name = py_from_js(node->name, no_ctx);
+    PyErr_PROPAGATE(name);
+    PyObject *script_name = construct_script_name(node->script_name, node->script_id);
+    if (script_name == NULL) {
+        Py_DECREF(name);
+        return NULL;
+    }
+
+    PyObject *allocations = PyList_New(node->allocations.size());
+    PyObject *children = PyList_New(node->children.size());
+    if (allocations == NULL || children == NULL) {
+        goto fail;
+    }
+    for (size_t i = 0; i < node->allocations.size(); i++) {
+        PyObject *allocation = Py_BuildValue("(nI)",
+                (Py_ssize_t) node->allocations[i].size, node->allocations[i].count);
+        if (allocation == NULL) goto fail;
+        PyList_SET_ITEM(allocations, i, allocation);
+    }
+    for (size_t i = 0; i < node->children.size(); i++) {
+        PyObject *child = py_from_allocation_node(node->children[i]);
+        if (child == NULL) goto fail;
+        PyList_SET_ITEM(children, i, child);
+    }
+
+    // N steals the references
+    return Py_BuildValue("{s:N,s:N,s:i,s:i,s:N,s:N}",
+            "name", name,
+            "script_name", script_name,
+            "line_number", node->line_number,
+            "column_number", node->column_number,
+            "allocations", allocations,
+            "children", children);
+
+fail:
+    Py_DECREF(name);
+    Py_DECREF(script_name);
+    Py_XDECREF(allocations);
+    Py_XDECREF(children);
+    return NULL;
+}
+
+// Returns the allocation tree collected since the profiler was started. Each
+// node has the allocations attributed to it as (size, count) pairs.
+PyObject *stop_sampling_heap_profiler(PyObject *shit, PyObject *noargs) {
+    IN_V8;
+    HeapProfiler *profiler = isolate->GetHeapProfiler();
+    AllocationProfile *profile = profiler->GetAllocationProfile();
+    if (profile == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "sampling heap profiler is not running");
+        return NULL;
+    }
+    PyObject *tree = py_from_allocation_node(profile->GetRootNode());
+    delete profile;
+    profiler->StopSamplingHeapProfiler();
+    return tree;
+}
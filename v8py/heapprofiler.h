@@ -0,0 +1,29 @@
+#ifndef HEAPPROFILER_H
+#define HEAPPROFILER_H
+
+#include <Python.h>
+#include <v8.h>
+#include <v8-profiler.h>
+
+using namespace v8;
+
+PyObject *take_heap_snapshot(PyObject *shit, PyObject *args, PyObject *kwargs);
+PyObject *start_sampling_heap_profiler(PyObject *shit, PyObject *args, PyObject *kwargs);
+PyObject *stop_sampling_heap_profiler(PyObject *shit, PyObject *noargs);
+
+// Hands each chunk of the serialized snapshot straight to a Python file's
+// write method, so the whole thing never has to be in memory at once.
+class PyFileOutputStream : public OutputStream {
+    public:
+        PyFileOutputStream(PyObject *write) : write_(write), failed_(false) {}
+        int GetChunkSize() override { return 64 * 1024; }
+        void EndOfStream() override {}
+        WriteResult WriteAsciiChunk(char *data, int size) override;
+        bool failed() { return failed_; }
+
+    private:
+        PyObject *write_;
+        bool failed_;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include <Python.h>
+#include "v8py.h"
+#include <v8.h>
+#include <vector>
+
+#include "script.h"
+#include "stats.h"
+#include "hooks.h"
+
+using namespace v8;
+
+bool hook_enabled = false;
+
+struct hook_event {
+    hook_event_kind kind;
+    PyObject *script_name;
+    PyObject *function_name;
+    double timestamp;
+};
+
+static PyObject *hook_sink = NULL;
+static size_t hook_batch_size = 64;
+static std::vector<hook_event> hook_events;
+static PyObject *hook_event_names[HOOK_EXCEPTION + 1];
+
+static void hook_events_clear(std::vector<hook_event> &events) {
+    for (hook_event &event : events) {
+        Py_XDECREF(event.script_name);
+        Py_XDECREF(event.function_name);
+    }
+    events.clear();
+}
+
+static PyObject *py_from_hook_events(std::vector<hook_event> &events) {
+    PyObject *batch = PyList_New(events.size());
+    PyErr_PROPAGATE(batch);
+    for (size_t i = 0; i < events.size(); i++) {
+        hook_event &event = events[i];
+        PyObject *py_event = Py_BuildValue("(OOOd)",
+                hook_event_names[event.kind],
+                event.script_name != NULL ? event.script_name : Py_None,
+                event.function_name != NULL ? event.function_name : Py_None,
+                event.timestamp);
+        if (py_event == NULL) {
+            Py_DECREF(batch);
+            return NULL;
+        }
+        PyList_SET_ITEM(batch, i, py_event);
+    }
+    return batch;
+}
+
+// The sink runs wherever the batch happened to fill up, so whatever exception
+// is on its way somewhere gets put aside, and whatever the sink raises gets
+// reported instead of raised. What the sink does itself isn't recorded.
+static void hook_deliver() {
+    if (hook_events.empty() || hook_sink == NULL) return;
+    std::vector<hook_event> events;
+    events.swap(hook_events);
+
+    PyObject *exc_type, *exc_value, *exc_traceback;
+    PyErr_Fetch(&exc_type, &exc_value, &exc_traceback);
+    PyObject *sink = hook_sink;
+    Py_INCREF(sink);
+    hook_enabled = false;
+    PyObject *batch = py_from_hook_events(events);
+    PyObject *result = batch == NULL ? NULL : PyObject_CallFunctionObjArgs(sink, batch, NULL);
+    if (result == NULL) {
+        PyErr_WriteUnraisable(sink);
+    }
+    Py_XDECREF(result);
+    Py_XDECREF(batch);
+    // unless the sink took itself out
+    hook_enabled = hook_sink != NULL;
+    Py_DECREF(sink);
+    PyErr_Restore(exc_type, exc_value, exc_traceback);
+    hook_events_clear(events);
+}
+
+void hook_record(hook_event_kind kind, PyObject *script_name, PyObject *function_name) {
+    Py_XINCREF(script_name);
+    Py_XINCREF(function_name);
+    hook_event event = {kind, script_name, function_name, platform_time()};
+    hook_events.push_back(event);
+    if (hook_events.size() >= hook_batch_size) {
+        hook_deliver();
+    }
+}
+
+void hook_record_callback(hook_event_kind kind, PyObject *callable) {
+    HandleScope hs(isolate);
+    // on the way out, the callback could have raised
+    PyObject *exc_type, *exc_value, *exc_traceback;
+    PyErr_Fetch(&exc_type, &exc_value, &exc_traceback);
+    PyObject *script_name = NULL;
+    Local<StackTrace> js_stack = StackTrace::CurrentStackTrace(isolate, 1,
+            (StackTrace::StackTraceOptions) (StackTrace::kScriptName | StackTrace::kScriptId));
+    if (js_stack->GetFrameCount() > 0) {
+        Local<StackFrame> frame = js_stack->GetFrame(0);
+        script_name = construct_script_name(frame->GetScriptName(), frame->GetScriptId());
+    }
+    PyObject *function_name = PyObject_GetAttrString(callable, "__name__");
+    // a missing name just means the event goes without one
+    PyErr_Clear();
+    hook_record(kind, script_name, function_name);
+    Py_XDECREF(script_name);
+    Py_XDECREF(function_name);
+    PyErr_Restore(exc_type, exc_value, exc_traceback);
+}
+
+void hook_record_exception(PyObject *script_name) {
+    PyObject *exc_type, *exc_value, *exc_traceback;
+    PyErr_Fetch(&exc_type, &exc_value, &exc_traceback);
+    if (exc_type == NULL) return;
+    PyObject *type_name = PyObject_GetAttrString(exc_type, "__name__");
+    PyErr_Clear();
+    hook_record(HOOK_EXCEPTION, script_name, type_name);
+    Py_XDECREF(type_name);
+    PyErr_Restore(exc_type, exc_value, exc_traceback);
+}
+
+// set_hook(sink, batch_size=64) makes sink get called with a list of up to
+// batch_size events at a time. set_hook(None) delivers what's left and turns
+// the hooks off.
+PyObject *set_hook(PyObject *shit, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"sink", "batch_size", NULL};
+    PyObject *sink;
+    Py_ssize_t batch_size = 64;
+    if (PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", (char **) keywords, &sink, &batch_size) < 0) {
+        return NULL;
+    }
+    if (sink != Py_None && !PyCallable_Check(sink)) {
+        PyErr_SetString(PyExc_TypeError, "sink must be callable or None");
+        return NULL;
+    }
+    if (batch_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "batch_size must be positive");
+        return NULL;
+    }
+    if (hook_event_names[0] == NULL) {
+        const char *names[] = {"eval_start", "eval_end", "callback_enter", "callback_exit", "exception"};
+        for (int i = 0; i <= HOOK_EXCEPTION; i++) {
+            hook_event_names[i] = PyString_InternFromString(names[i]);
+            PyErr_PROPAGATE(hook_event_names[i]);
+        }
+    }
+
+    // the old sink gets everything recorded while it was the sink
+    hook_deliver();
+    Py_CLEAR(hook_sink);
+    if (sink != Py_None) {
+        Py_INCREF(sink);
+        hook_sink = sink;
+    }
+    hook_batch_size = (size_t) batch_size;
+    hook_enabled = hook_sink != NULL;
+    Py_RETURN_NONE;
+}
+
+PyObject *flush_hook(PyObject *shit, PyObject *noargs) {
+    hook_deliver();
+    Py_RETURN_NONE;
+}
@@ -0,0 +1,40 @@
+#ifndef HOOKS_H
+#define HOOKS_H
+
+#include <Python.h>
+#include <v8.h>
+
+using namespace v8;
+
+// Something like sys.setprofile for the boundary between Python and JS. The
+// events are (event, script name, function name, timestamp) tuples, handed
+// to the sink in batches. While there's no sink each hook is one branch on
+// hook_enabled.
+enum hook_event_kind {
+    HOOK_EVAL_START,
+    HOOK_EVAL_END,
+    HOOK_CALLBACK_ENTER,
+    HOOK_CALLBACK_EXIT,
+    HOOK_EXCEPTION,
+};
+
+extern bool hook_enabled;
+// Both names can be NULL. Doesn't steal the references.
+void hook_record(hook_event_kind kind, PyObject *script_name, PyObject *function_name);
+// For Python called from JS. The script is whichever one the JS that called
+// it is in, and the function name comes from the callable's __name__.
+void hook_record_callback(hook_event_kind kind, PyObject *callable);
+// For the exception that's set right now.
+void hook_record_exception(PyObject *script_name);
+
+#define HOOK_EVENT(kind, script_name, function_name) \
+    if (hook_enabled) hook_record(kind, script_name, function_name);
+#define HOOK_CALLBACK(kind, callable) \
+    if (hook_enabled) hook_record_callback(kind, callable);
+#define HOOK_EXCEPTION(script_name) \
+    if (hook_enabled) hook_record_exception(script_name);
+
+PyObject *set_hook(PyObject *shit, PyObject *args, PyObject *kwargs);
+PyObject *flush_hook(PyObject *shit, PyObject *noargs);
+
+#endif
@@ -0,0 +1,97 @@
+"""Hand V8 idle time from an event loop so collections happen between
+requests instead of in the middle of them."""
+
+from _v8py import idle_notification
+
+
+class _IdleCollector(object):
+    def __init__(self, idle_time, interval):
+        self.idle_time = idle_time
+        self.interval = interval
+
+    def collect(self):
+        return idle_notification(self.idle_time)
+
+
+class AsyncioIdleCollector(_IdleCollector):
+    """Wakes up every interval seconds and, if the loop has nothing else ready
+    to run and isn't running behind, gives V8 idle_time seconds.
+
+    Only the event loops that come with CPython's asyncio say whether they
+    have callbacks ready. On other loops, such as uvloop, only how far behind
+    the loop is running counts."""
+
+    def __init__(self, loop, idle_time, interval):
+        super(AsyncioIdleCollector, self).__init__(idle_time, interval)
+        self.loop = loop
+        self._handle = None
+        self._expected = None
+
+    def start(self):
+        self._expected = self.loop.time() + self.interval
+        self._handle = self.loop.call_later(self.interval, self._tick)
+
+    def stop(self):
+        if self._handle is not None:
+            self._handle.cancel()
+            self._handle = None
+
+    def _tick(self):
+        now = self.loop.time()
+        # if the timer fired late or there are callbacks waiting, the loop is
+        # busy and V8 will have to wait
+        lag = now - self._expected
+        if lag < self.idle_time and not self._has_ready_callbacks():
+            self.collect()
+        self._expected = self.loop.time() + self.interval
+        self._handle = self.loop.call_later(self.interval, self._tick)
+
+    def _has_ready_callbacks(self):
+        # there's no public way to ask, so this looks at the ready queue of
+        # asyncio's own loops and gives up on anything else
+        ready = getattr(self.loop, '_ready', None)
+        if ready is None:
+            return False
+        return len(ready) > 0
+
+
+class GeventIdleCollector(_IdleCollector):
+    """Every interval seconds, arms a libev idle watcher, which only fires
+    once the hub has no other events to process."""
+
+    def __init__(self, hub, idle_time, interval):
+        super(GeventIdleCollector, self).__init__(idle_time, interval)
+        self.hub = hub
+        self._timer = hub.loop.timer(interval, interval)
+        self._idle = hub.loop.idle()
+
+    def start(self):
+        self._timer.start(self._arm)
+
+    def stop(self):
+        self._timer.stop()
+        self._idle.stop()
+
+    def _arm(self):
+        if not self._idle.active:
+            self._idle.start(self._on_idle)
+
+    def _on_idle(self):
+        self._idle.stop()
+        self.collect()
+
+
+def asyncio_idle_gc(loop=None, idle_time=0.01, interval=0.1):
+    import asyncio
+    if loop is None:
+        loop = asyncio.get_event_loop()
+    collector = AsyncioIdleCollector(loop, idle_time, interval)
+    collector.start()
+    return collector
+
+
+def gevent_idle_gc(idle_time=0.01, interval=0.1):
+    import gevent
+    collector = GeventIdleCollector(gevent.get_hub(), idle_time, interval)
+    collector.start()
+    return collector
@@ -5,12 +5,23 @@
 #include "jsobject.h"
 #include "convert.h"
 #include "context.h"
+#include "stats.h"
+#include "tracing.h"
 
 using namespace v8;
 
 PyTypeObject js_function_type = {
     PyVarObject_HEAD_INIT(NULL, 0)
 };
+PyMethodDef js_function_methods[] = {
+    {"map", (PyCFunction) js_function_map, METH_VARARGS | METH_KEYWORDS, NULL},
+    {"starmap", (PyCFunction) js_function_starmap, METH_VARARGS | METH_KEYWORDS, NULL},
+    {NULL},
+};
+#ifdef HAVE_VECTORCALL
+static PyObject *js_function_vectorcall(js_function *self, PyObject *const *args, size_t nargsf, PyObject *kwnames);
+#endif
+
 int js_function_type_init() {
     js_function_type.tp_name = "v8py.BoundFunction";
     js_function_type.tp_basicsize = sizeof(js_function);
@@ -18,12 +29,31 @@ int js_function_type_init() {
     js_function_type.tp_flags = Py_TPFLAGS_DEFAULT;
     js_function_type.tp_doc = "";
     js_function_type.tp_call = (ternaryfunc) js_function_call;
+#ifdef HAVE_VECTORCALL
+    js_function_type.tp_flags |= Py_TPFLAGS_HAVE_VECTORCALL;
+    js_function_type.tp_vectorcall_offset = offsetof(js_function, vectorcall);
+#endif
+    js_function_type.tp_methods = js_function_methods;
     js_function_type.tp_base = &js_object_type;
     return PyType_Ready(&js_function_type);
 }
 
-PyObject *js_function_call(js_function *self, PyObject *args, PyObject *kwargs) {
+js_function *js_function_alloc() {
+    js_function *self = (js_function *) js_function_type.tp_alloc(&js_function_type, 0);
+#ifdef HAVE_VECTORCALL
+    if (self != NULL) {
+        self->vectorcall = (vectorcallfunc) js_function_vectorcall;
+    }
+#endif
+    return self;
+}
+
+// Keyword arguments get passed as one object after all the positional
+// arguments. They're either names in kwnames with the values following the
+// positional arguments (vectorcall) or a dict (tp_call).
+static PyObject *js_function_invoke(js_function *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames, PyObject *kwargs) {
     IN_V8;
+    TRACE_EVENT(trace_v8py, "JSFunction.call");
     Local<Object> object = self->object.Get(isolate);
     IN_CONTEXT(object->CreationContext());
     JS_TRY
@@ -34,31 +64,253 @@ PyObject *js_function_call(js_function *self, PyObject *args, PyObject *kwargs)
     } else {
         js_this = self->js_this.Get(isolate);
     }
-    int argc = PyTuple_GET_SIZE(args);
-    MaybeLocal<Value> result;
-
-    if (!context_setup_timeout(context)) return NULL;
-#ifndef _WIN32
-    // error C2131: expression did not evaluate to a constant on Windows
-    if (argc <= 16) {
-        Local<Value> argv[argc];
-        jss_from_pys(args, &argv[0], context);
-        result = object->CallAsFunction(context, js_this, argc, &argv[0]);
-    } else {
-#endif
-        Local<Value> *argv = new Local<Value>[argc];
-        jss_from_pys(args, argv, context);
-        result = object->CallAsFunction(context, js_this, argc, argv);
-        delete[] argv;
-#ifndef _WIN32
+
+    bool has_options = (kwnames != NULL && PyTuple_GET_SIZE(kwnames) > 0) ||
+        (kwargs != NULL && PyDict_Size(kwargs) > 0);
+    int argc = (int) nargs + (has_options ? 1 : 0);
+    Local<Value> argv_stack[ARGS_STACK_SIZE + 1];
+    Local<Value> *argv = argc <= ARGS_STACK_SIZE + 1 ? argv_stack : new Local<Value>[argc];
+    for (Py_ssize_t i = 0; i < nargs; i++) {
+        argv[i] = js_from_py(args[i], context);
     }
-#endif
-    if (!context_cleanup_timeout(context)) return NULL;
+    if (has_options) {
+        Local<Object> options = Object::New(isolate);
+        if (kwnames != NULL) {
+            for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(kwnames); i++) {
+                options->CreateDataProperty(context, js_from_py(PyTuple_GET_ITEM(kwnames, i), context).As<Name>(),
+                        js_from_py(args[nargs + i], context));
+            }
+        } else {
+            PyObject *name, *value;
+            Py_ssize_t pos = 0;
+            while (PyDict_Next(kwargs, &pos, &name, &value)) {
+                options->CreateDataProperty(context, js_from_py(name, context).As<Name>(), js_from_py(value, context));
+            }
+        }
+        argv[nargs] = options;
+    }
+
+    if (!context_setup_timeout(context)) {
+        if (argv != argv_stack) delete[] argv;
+        return NULL;
+    }
+    STATS_START(context);
+    MaybeLocal<Value> result = object->CallAsFunction(context, js_this, argc, argv);
+    STATS_STOP(calls, js_time);
+    bool cleaned_up = context_cleanup_timeout(context);
+    if (argv != argv_stack) delete[] argv;
+    if (!cleaned_up) return NULL;
     PY_PROPAGATE_JS;
     return py_from_js(result.ToLocalChecked(), context);
 }
 
+PyObject *js_function_call(js_function *self, PyObject *args, PyObject *kwargs) {
+    Py_ssize_t nargs = PyTuple_GET_SIZE(args);
+    // an empty tuple has no item 0 to take the address of
+    return js_function_invoke(self, nargs > 0 ? &PyTuple_GET_ITEM(args, 0) : NULL, nargs, NULL, kwargs);
+}
+
+#ifdef HAVE_VECTORCALL
+static PyObject *js_function_vectorcall(js_function *self, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    return js_function_invoke(self, args, PyVectorcall_NARGS(nargsf), kwnames, NULL);
+}
+#endif
+
 void js_function_dealloc(js_function *self) {
     self->js_this.Reset();
     js_object_dealloc((js_object *) self);
 }
+
+// Calls the function once for each item from iterator, stopping after limit
+// calls (or never, if it's negative), and returns a list of the results. The
+// lock and TryCatch are only set up once for the whole batch, which is the
+// point. The timeout applies to each call, so it doesn't count the time spent
+// getting items out of the iterator.
+static PyObject *js_function_call_batch(js_function *self, PyObject *iterator, bool star, Py_ssize_t limit) {
+    PyObject *results = PyList_New(0);
+    PyErr_PROPAGATE(results);
+
+    IN_V8;
+    TRACE_EVENT(trace_v8py, "JSFunction.map");
+    Local<Object> object = self->object.Get(isolate);
+    IN_CONTEXT(object->CreationContext());
+    JS_TRY
+
+    Local<Value> js_this;
+    if (self->js_this.IsEmpty()) {
+        js_this = Undefined(isolate);
+    } else {
+        js_this = self->js_this.Get(isolate);
+    }
+
+    bool failed = false;
+    bool cleaned_up = true;
+    Local<Value> argv_stack[ARGS_STACK_SIZE];
+    while (limit < 0 || PyList_GET_SIZE(results) < limit) {
+        PyObject *item = PyIter_Next(iterator);
+        if (item == NULL) {
+            failed = PyErr_Occurred() != NULL;
+            break;
+        }
+        // one handle scope for the whole batch would keep every argument and
+        // result alive until the end
+        HandleScope item_hs(isolate);
+        int argc;
+        Local<Value> *argv = argv_stack;
+        if (star) {
+            PyObject *args = PySequence_Fast(item, "starmap items must be sequences");
+            Py_DECREF(item);
+            if (args == NULL) {
+                failed = true;
+                break;
+            }
+            argc = (int) PySequence_Fast_GET_SIZE(args);
+            if (argc > ARGS_STACK_SIZE) argv = new Local<Value>[argc];
+            for (int i = 0; i < argc; i++) {
+                argv[i] = js_from_py(PySequence_Fast_GET_ITEM(args, i), context);
+            }
+            Py_DECREF(args);
+        } else {
+            argc = 1;
+            argv[0] = js_from_py(item, context);
+            Py_DECREF(item);
+        }
+
+        if (!context_setup_timeout(context)) {
+            if (argv != argv_stack) delete[] argv;
+            failed = true;
+            break;
+        }
+        STATS_START(context);
+        MaybeLocal<Value> result = object->CallAsFunction(context, js_this, argc, argv);
+        STATS_STOP(calls, js_time);
+        cleaned_up = context_cleanup_timeout(context);
+        if (argv != argv_stack) delete[] argv;
+        if (!cleaned_up || tc.HasCaught()) {
+            failed = true;
+            break;
+        }
+
+        PyObject *py_result = py_from_js(result.ToLocalChecked(), context);
+        if (py_result == NULL || PyList_Append(results, py_result) < 0) {
+            Py_XDECREF(py_result);
+            failed = true;
+            break;
+        }
+        Py_DECREF(py_result);
+    }
+
+    if (failed) {
+        Py_DECREF(results);
+        if (cleaned_up) {
+            PY_PROPAGATE_JS;
+        }
+        return NULL;
+    }
+    return results;
+}
+
+PyTypeObject js_batch_iterator_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+};
+int js_batch_iterator_type_init() {
+    js_batch_iterator_type.tp_name = "v8py.BatchIterator";
+    js_batch_iterator_type.tp_basicsize = sizeof(js_batch_iterator);
+    js_batch_iterator_type.tp_dealloc = (destructor) js_batch_iterator_dealloc;
+    // the iterable can refer back to the iterator
+    js_batch_iterator_type.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC;
+    js_batch_iterator_type.tp_traverse = (traverseproc) js_batch_iterator_traverse;
+    js_batch_iterator_type.tp_clear = (inquiry) js_batch_iterator_clear;
+    js_batch_iterator_type.tp_doc = "";
+    js_batch_iterator_type.tp_iter = PyObject_SelfIter;
+    js_batch_iterator_type.tp_iternext = (iternextfunc) js_batch_iterator_next;
+    return PyType_Ready(&js_batch_iterator_type);
+}
+
+PyObject *js_batch_iterator_next(js_batch_iterator *self) {
+    if (self->buffer == NULL || self->position >= PyList_GET_SIZE(self->buffer)) {
+        Py_CLEAR(self->buffer);
+        if (self->iterator == NULL || self->function == NULL) {
+            return NULL;
+        }
+        self->buffer = js_function_call_batch(self->function, self->iterator, self->star, self->chunk_size);
+        self->position = 0;
+        PyErr_PROPAGATE(self->buffer);
+        if (PyList_GET_SIZE(self->buffer) < self->chunk_size) {
+            // the source iterator is done
+            Py_CLEAR(self->iterator);
+        }
+        if (PyList_GET_SIZE(self->buffer) == 0) {
+            return NULL;
+        }
+    }
+    PyObject *item = PyList_GET_ITEM(self->buffer, self->position++);
+    Py_INCREF(item);
+    return item;
+}
+
+int js_batch_iterator_traverse(js_batch_iterator *self, visitproc visit, void *arg) {
+    Py_VISIT(self->function);
+    Py_VISIT(self->iterator);
+    Py_VISIT(self->buffer);
+    return 0;
+}
+
+int js_batch_iterator_clear(js_batch_iterator *self) {
+    Py_CLEAR(self->function);
+    Py_CLEAR(self->iterator);
+    Py_CLEAR(self->buffer);
+    return 0;
+}
+
+void js_batch_iterator_dealloc(js_batch_iterator *self) {
+    PyObject_GC_UnTrack(self);
+    js_batch_iterator_clear(self);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *js_function_map_impl(js_function *self, PyObject *args, PyObject *kwargs, bool star) {
+    static const char *keywords[] = {"iterable", "stream", "chunk_size", NULL};
+    PyObject *iterable;
+    PyObject *stream = Py_False;
+    Py_ssize_t chunk_size = 1024;
+    if (PyArg_ParseTupleAndKeywords(args, kwargs, "O|On", (char **) keywords, &iterable, &stream, &chunk_size) < 0) {
+        return NULL;
+    }
+    if (chunk_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "chunk_size must be positive");
+        return NULL;
+    }
+    int should_stream = PyObject_IsTrue(stream);
+    if (should_stream < 0) return NULL;
+
+    PyObject *iterator = PyObject_GetIter(iterable);
+    PyErr_PROPAGATE(iterator);
+    if (!should_stream) {
+        PyObject *results = js_function_call_batch(self, iterator, star, -1);
+        Py_DECREF(iterator);
+        return results;
+    }
+
+    js_batch_iterator *batch = (js_batch_iterator *) js_batch_iterator_type.tp_alloc(&js_batch_iterator_type, 0);
+    if (batch == NULL) {
+        Py_DECREF(iterator);
+        return NULL;
+    }
+    Py_INCREF(self);
+    batch->function = self;
+    batch->iterator = iterator;
+    batch->star = star;
+    batch->chunk_size = chunk_size;
+    batch->buffer = NULL;
+    batch->position = 0;
+    return (PyObject *) batch;
+}
+
+PyObject *js_function_map(js_function *self, PyObject *args, PyObject *kwargs) {
+    return js_function_map_impl(self, args, kwargs, false);
+}
+
+PyObject *js_function_starmap(js_function *self, PyObject *args, PyObject *kwargs) {
+    return js_function_map_impl(self, args, kwargs, true);
+}
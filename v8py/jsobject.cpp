@@ -54,7 +54,7 @@ js_object *js_object_new(Local<Object> object, Local<Context> context) {
     if (object->IsPromise()) {
         self = (js_object *) js_promise_type.tp_alloc(&js_promise_type, 0);
     } else if (object->IsCallable()) {
-        self = (js_object *) js_function_type.tp_alloc(&js_function_type, 0);
+        self = (js_object *) js_function_alloc();
     } else {
         self = (js_object *) js_object_type.tp_alloc(&js_object_type, 0);
     }
@@ -65,33 +65,6 @@ js_object *js_object_new(Local<Object> object, Local<Context> context) {
     return self;
 }
 
-void js_object_weak_callback(const WeakCallbackInfo<js_object> &info) {
-    js_object *self = info.GetParameter();
-    self->object.Reset();
-
-    Py_DECREF(self);
-}
-
-js_object *js_object_weak_new(Local<Object> object, Local<Context> context) {
-    IN_V8;
-    Context::Scope cs(context);
-    js_object *self;
-    if (object->IsPromise()) {
-        self = (js_object *) js_promise_type.tp_alloc(&js_promise_type, 0);
-    } else if (object->IsCallable()) {
-        self = (js_object *) js_function_type.tp_alloc(&js_function_type, 0);
-    } else {
-        self = (js_object *) js_object_type.tp_alloc(&js_object_type, 0);
-    }
-
-
-    if (self != NULL) {
-        self->object.Reset(isolate, object);
-        self->object.SetWeak(self, js_object_weak_callback, WeakCallbackType::kFinalizer);
-    }
-    return self;
-}
-
 PyObject *js_object_getattro(js_object *self, PyObject *name) {
     if (PyObject_GenericHasAttr((PyObject *) self, name)) {
         return PyObject_GenericGetAttr((PyObject *) self, name);
@@ -4,6 +4,8 @@
 #include <Python.h>
 #include <v8.h>
 
+#include "polyfill.h"
+
 using namespace v8;
 
 typedef struct {
@@ -14,7 +16,6 @@ extern PyTypeObject js_object_type;
 int js_object_type_init();
 
 js_object *js_object_new(Local<Object> object, Local<Context> context);
-js_object *js_object_weak_new(Local<Object> object, Local<Context> context);
 PyObject *js_object_fake_new(PyTypeObject *type, PyObject *args, PyObject *kwargs);
 void js_object_dealloc(js_object *self);
 
@@ -29,13 +30,38 @@ typedef struct {
     PyObject_HEAD
     Persistent<Object> object;
     Persistent<Value> js_this;
+#ifdef HAVE_VECTORCALL
+    vectorcallfunc vectorcall;
+#endif
 } js_function;
 extern PyTypeObject js_function_type;
 int js_function_type_init();
 
+js_function *js_function_alloc();
 PyObject *js_function_call(js_function *self, PyObject *args, PyObject *kwargs);
 PyObject *js_function_new(js_function *self, PyObject *args);
 void js_function_dealloc(js_function *self);
+PyObject *js_function_map(js_function *self, PyObject *args, PyObject *kwargs);
+PyObject *js_function_starmap(js_function *self, PyObject *args, PyObject *kwargs);
+
+// What map and starmap return when asked to stream. Results are produced
+// chunk_size at a time.
+typedef struct {
+    PyObject_HEAD
+    js_function *function;
+    PyObject *iterator;
+    bool star;
+    Py_ssize_t chunk_size;
+    PyObject *buffer;
+    Py_ssize_t position;
+} js_batch_iterator;
+extern PyTypeObject js_batch_iterator_type;
+int js_batch_iterator_type_init();
+
+PyObject *js_batch_iterator_next(js_batch_iterator *self);
+int js_batch_iterator_traverse(js_batch_iterator *self, visitproc visit, void *arg);
+int js_batch_iterator_clear(js_batch_iterator *self);
+void js_batch_iterator_dealloc(js_batch_iterator *self);
 
 typedef struct {
     PyObject_HEAD
@@ -0,0 +1,279 @@
+#include <Python.h>
+#include "v8py.h"
+#include <v8.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "convert.h"
+#include "script.h"
+#include "mixedprofiler.h"
+
+using namespace v8;
+
+bool mixed_profiling = false;
+
+// JS stacks deeper than this get cut off at the outermost end, on both the
+// samples and the boundaries, so they still line up
+#define MIXED_STACK_LIMIT 256
+
+// A place where JS called into Python: the Python frame that was running when
+// it happened, how many JS frames were on the stack, and which run of the
+// profiler it was recorded in.
+struct mixed_boundary {
+    PyFrameObject *anchor;
+    int js_depth;
+    unsigned run;
+};
+// goes up every time the profiler starts, so a callback that was already
+// going when it restarted can't pop the new run's boundaries
+static unsigned mixed_run = 0;
+static std::vector<mixed_boundary> boundaries;
+
+// folded stack -> number of samples
+static PyObject *samples = NULL;
+
+// The sampler thread can't look at either stack, so it asks the main thread
+// to take the sample. If JS is running, a V8 interrupt gets there first, and
+// if Python is, a pending call does. Whichever it is takes the sample and the
+// other one finds nothing to do. While the main thread is idle, neither runs,
+// so idle time doesn't show up, as it shouldn't.
+static std::atomic<bool> sample_requested(false);
+static std::atomic<bool> interrupt_queued(false);
+static std::atomic<bool> pending_call_queued(false);
+
+static std::thread *sampler = NULL;
+static std::mutex sampler_mutex;
+static std::condition_variable sampler_wakeup;
+static bool sampler_stopping = false;
+
+unsigned mixed_profiler_enter() {
+    HandleScope hs(isolate);
+    Local<StackTrace> js_stack = StackTrace::CurrentStackTrace(isolate, MIXED_STACK_LIMIT, StackTrace::kLineNumber);
+    mixed_boundary boundary = {PyEval_GetFrame(), js_stack->GetFrameCount(), mixed_run};
+    boundaries.push_back(boundary);
+    return mixed_run;
+}
+
+void mixed_profiler_exit(unsigned run) {
+    // the profiler could have been stopped or restarted since
+    if (!boundaries.empty() && boundaries.back().run == run) {
+        boundaries.pop_back();
+    }
+}
+
+static int append_js_frame(PyObject *names, Local<StackFrame> frame) {
+    Local<String> js_function_name = frame->GetFunctionName();
+    PyObject *function_name;
+    if (js_function_name.IsEmpty() || js_function_name->Length() == 0) {
+        function_name = PyUnicode_FromString("(anonymous)");
+    } else {
+        function_name = py_from_js_string(js_function_name);
+    }
+    PyErr_PROPAGATE_(function_name);
+    PyObject *script_name = construct_script_name(frame->GetScriptName(), frame->GetScriptId());
+    if (script_name == NULL) {
+        Py_DECREF(function_name);
+        return -1;
+    }
+    PyObject *name = PyUnicode_FromFormat("%S (%S:%d)", function_name, script_name, frame->GetLineNumber());
+    Py_DECREF(function_name);
+    Py_DECREF(script_name);
+    PyErr_PROPAGATE_(name);
+    int result = PyList_Append(names, name);
+    Py_DECREF(name);
+    return result;
+}
+
+static int append_py_frame(PyObject *names, PyFrameObject *frame) {
+    PyCodeObject *code = PyFrame_GetCode(frame);
+    PyObject *name = PyUnicode_FromFormat("%S (%S:%d)", code->co_name, code->co_filename, PyFrame_GetLineNumber(frame));
+    Py_DECREF(code);
+    PyErr_PROPAGATE_(name);
+    int result = PyList_Append(names, name);
+    Py_DECREF(name);
+    return result;
+}
+
+// Appends the JS frames from depth start up to depth end, counted from the
+// outermost, which is the opposite of how the stack trace counts them.
+static int append_js_frames(PyObject *names, Local<StackTrace> js_stack, int start, int end) {
+    int count = js_stack->GetFrameCount();
+    if (end > count) end = count;
+    for (int depth = start; depth < end; depth++) {
+        if (append_js_frame(names, js_stack->GetFrame(count - 1 - depth)) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Each JS segment goes right after the Python frame that called into it.
+// Whatever JS is left over is running right now, on top of everything.
+static PyObject *mixed_stack() {
+    Local<StackTrace> js_stack = StackTrace::CurrentStackTrace(isolate, MIXED_STACK_LIMIT,
+            (StackTrace::StackTraceOptions) (StackTrace::kOverview | StackTrace::kScriptId));
+
+    // innermost first
+    std::vector<PyFrameObject *> py_frames;
+    PyFrameObject *frame = PyEval_GetFrame();
+    Py_XINCREF(frame);
+    while (frame != NULL) {
+        py_frames.push_back(frame);
+        frame = PyFrame_GetBack(frame);
+    }
+
+    PyObject *names = PyList_New(0);
+    int js_done = 0;
+    size_t next_boundary = 0;
+    if (names == NULL) goto fail;
+    // JS that was called with no Python on the stack
+    while (next_boundary < boundaries.size() && boundaries[next_boundary].anchor == NULL) {
+        if (append_js_frames(names, js_stack, js_done, boundaries[next_boundary].js_depth) < 0) goto fail;
+        js_done = boundaries[next_boundary].js_depth;
+        next_boundary++;
+    }
+    for (size_t i = py_frames.size(); i > 0; i--) {
+        PyFrameObject *py_frame = py_frames[i - 1];
+        if (append_py_frame(names, py_frame) < 0) goto fail;
+        while (next_boundary < boundaries.size() && boundaries[next_boundary].anchor == py_frame) {
+            if (append_js_frames(names, js_stack, js_done, boundaries[next_boundary].js_depth) < 0) goto fail;
+            js_done = boundaries[next_boundary].js_depth;
+            next_boundary++;
+        }
+    }
+    if (append_js_frames(names, js_stack, js_done, js_stack->GetFrameCount()) < 0) goto fail;
+
+    for (PyFrameObject *py_frame : py_frames) {
+        Py_DECREF(py_frame);
+    }
+    {
+        PyObject *separator = PyUnicode_FromString(";");
+        if (separator == NULL) {
+            Py_DECREF(names);
+            return NULL;
+        }
+        PyObject *folded = PyUnicode_Join(separator, names);
+        Py_DECREF(separator);
+        Py_DECREF(names);
+        return folded;
+    }
+
+fail:
+    for (PyFrameObject *py_frame : py_frames) {
+        Py_DECREF(py_frame);
+    }
+    Py_XDECREF(names);
+    return NULL;
+}
+
+static void take_sample() {
+    if (!mixed_profiling || !sample_requested.exchange(false)) {
+        return;
+    }
+    IN_V8;
+    // this can run in the middle of anything, so it mustn't disturb an
+    // exception that's on its way somewhere
+    PyObject *exc_type, *exc_value, *exc_traceback;
+    PyErr_Fetch(&exc_type, &exc_value, &exc_traceback);
+    PyObject *folded = mixed_stack();
+    if (folded != NULL) {
+        PyObject *count = PyDict_GetItem(samples, folded);
+        PyObject *new_count = PyLong_FromLong(count == NULL ? 1 : PyLong_AsLong(count) + 1);
+        if (new_count != NULL) {
+            PyDict_SetItem(samples, folded, new_count);
+            Py_DECREF(new_count);
+        }
+        Py_DECREF(folded);
+    }
+    // a sample that can't be taken just gets dropped
+    PyErr_Clear();
+    PyErr_Restore(exc_type, exc_value, exc_traceback);
+}
+
+static void sample_interrupt(Isolate *isolate, void *data) {
+    interrupt_queued = false;
+    take_sample();
+}
+
+static int sample_pending_call(void *data) {
+    pending_call_queued = false;
+    take_sample();
+    return 0;
+}
+
+static void sampler_main(int sample_interval) {
+    std::unique_lock<std::mutex> lock(sampler_mutex);
+    while (!sampler_stopping) {
+        sampler_wakeup.wait_for(lock, std::chrono::microseconds(sample_interval));
+        if (sampler_stopping) break;
+        if (sample_requested.exchange(true)) {
+            // the last one hasn't been taken yet
+            continue;
+        }
+        // neither of these needs the GIL or the V8 lock
+        if (!interrupt_queued.exchange(true)) {
+            isolate->RequestInterrupt(sample_interrupt, NULL);
+        }
+        if (!pending_call_queued.exchange(true) && Py_AddPendingCall(sample_pending_call, NULL) < 0) {
+            // the queue is full, try again next time
+            pending_call_queued = false;
+        }
+    }
+}
+
+// sample_interval is in microseconds
+PyObject *start_mixed_profiler(PyObject *shit, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"sample_interval", NULL};
+    int sample_interval = 1000;
+    if (PyArg_ParseTupleAndKeywords(args, kwargs, "|i", (char **) keywords, &sample_interval) < 0) {
+        return NULL;
+    }
+    if (sample_interval <= 0) {
+        PyErr_SetString(PyExc_ValueError, "sample_interval must be positive");
+        return NULL;
+    }
+    if (mixed_profiling) {
+        PyErr_SetString(PyExc_RuntimeError, "mixed profiler is already running");
+        return NULL;
+    }
+
+    samples = PyDict_New();
+    PyErr_PROPAGATE(samples);
+    boundaries.clear();
+    mixed_run++;
+    if (mixed_run == 0) mixed_run = 1;
+    sample_requested = false;
+    mixed_profiling = true;
+    sampler_stopping = false;
+    sampler = new std::thread(sampler_main, sample_interval);
+    Py_RETURN_NONE;
+}
+
+// Returns a dict mapping each folded stack to the number of samples that
+// landed in it.
+PyObject *stop_mixed_profiler(PyObject *shit, PyObject *noargs) {
+    if (!mixed_profiling) {
+        PyErr_SetString(PyExc_RuntimeError, "mixed profiler is not running");
+        return NULL;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sampler_mutex);
+        sampler_stopping = true;
+    }
+    sampler_wakeup.notify_one();
+    sampler->join();
+    delete sampler;
+    sampler = NULL;
+
+    // whatever's still queued will find this off and do nothing
+    mixed_profiling = false;
+    boundaries.clear();
+    PyObject *result = samples;
+    samples = NULL;
+    return result;
+}
@@ -0,0 +1,41 @@
+#ifndef MIXEDPROFILER_H
+#define MIXEDPROFILER_H
+
+#include <Python.h>
+#include <v8.h>
+
+using namespace v8;
+
+// A sampling profiler that sees the Python and JS stacks as one. Each sample
+// is a stack of frame names, outermost first, in the folded form flame graph
+// tools read.
+PyObject *start_mixed_profiler(PyObject *shit, PyObject *args, PyObject *kwargs);
+PyObject *stop_mixed_profiler(PyObject *shit, PyObject *noargs);
+
+// Where JS called into Python has to be remembered while the profiler runs,
+// because neither stack knows where the other one fits in. When it's not
+// running this costs one branch per call into Python. Every path from JS
+// into Python code needs one of these, or samples in it come out with the
+// JS on top.
+extern bool mixed_profiling;
+// returns the run the boundary belongs to, which is never 0
+unsigned mixed_profiler_enter();
+void mixed_profiler_exit(unsigned run);
+
+#define MIXED_PROFILER_ENTER \
+    unsigned mixed_entered_ = mixed_profiling ? mixed_profiler_enter() : 0;
+#define MIXED_PROFILER_EXIT \
+    if (mixed_entered_) mixed_profiler_exit(mixed_entered_);
+
+// The same for the rest of the scope, for the interceptors, which have too
+// many ways out to pair them up by hand.
+struct mixed_profiler_scope {
+    unsigned run;
+    mixed_profiler_scope() : run(mixed_profiling ? mixed_profiler_enter() : 0) {}
+    ~mixed_profiler_scope() {
+        if (run) mixed_profiler_exit(run);
+    }
+};
+#define MIXED_PROFILER_SCOPE mixed_profiler_scope mixed_profiler_scope_
+
+#endif
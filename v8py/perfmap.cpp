@@ -0,0 +1,189 @@
+#include <Python.h>
+#include "v8py.h"
+#include <v8.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "perfmap.h"
+
+using namespace v8;
+
+// The isolate gets made when v8py is imported, so anything that has to be
+// set up before that comes from the environment:
+//   V8PY_PERF_MAP=1        write the perf map from the start
+//   V8PY_PERF_MAP=jitdump  also have V8 write jit-<pid>.dump for perf inject,
+//                          which has V8's own names for things
+#define PERF_MAP_ENV "V8PY_PERF_MAP"
+
+static FILE *perf_map = NULL;
+static bool perf_map_written = false;
+
+// script id -> resource name as V8 writes it, and v8py's name for it
+struct perf_script_name {
+    std::string resource;
+    std::string name;
+};
+static std::unordered_map<int, perf_script_name> script_names;
+// code start -> size and name, so moved code can be written again at the new
+// address
+struct perf_code {
+    size_t size;
+    std::string name;
+};
+static std::unordered_map<void *, perf_code> code_names;
+
+// The same as construct_script_name, but this can't call into Python because
+// it runs in the middle of compiling and GCs.
+static const perf_script_name &script_name_for(Local<UnboundScript> script) {
+    int id = script->GetId();
+    auto cached = script_names.find(id);
+    if (cached != script_names.end()) {
+        return cached->second;
+    }
+    perf_script_name names;
+    Local<Value> js_name = script->GetScriptName();
+    if (!js_name.IsEmpty() && js_name->IsString()) {
+        String::Utf8Value resource(js_name);
+        names.resource = *resource;
+        names.name = names.resource;
+    } else {
+        names.name = "javascript";
+    }
+    if (id != 0) {
+        names.name += "-" + std::to_string(id);
+    }
+    return script_names[id] = names;
+}
+
+// V8 names JS code "Tag:name resource:line". The resource gets swapped for
+// the script name.
+static std::string code_name_for(const JitCodeEvent *event) {
+    std::string name(event->name.str, event->name.len);
+    if (event->script.IsEmpty()) {
+        return name;
+    }
+    const perf_script_name &script_name = script_name_for(event->script);
+    size_t colon = name.rfind(':');
+    size_t space = std::string::npos;
+    if (colon != std::string::npos && colon > 0) {
+        if (!script_name.resource.empty()) {
+            size_t resource_start = colon - script_name.resource.size();
+            if (colon > script_name.resource.size() &&
+                    name.compare(resource_start, script_name.resource.size(), script_name.resource) == 0 &&
+                    name[resource_start - 1] == ' ') {
+                space = resource_start - 1;
+            }
+        } else {
+            space = name.rfind(' ', colon);
+        }
+    }
+    if (space == std::string::npos) {
+        return name + " [" + script_name.name + "]";
+    }
+    return name.substr(0, space) + " " + script_name.name + name.substr(colon);
+}
+
+static void write_code(void *start, const perf_code &code) {
+    fprintf(perf_map, "%" PRIxPTR " %zx %s\n", (uintptr_t) start, code.size, code.name.c_str());
+}
+
+static void perf_map_event(const JitCodeEvent *event) {
+    if (perf_map == NULL) return;
+    HandleScope hs(isolate);
+    switch (event->type) {
+        case JitCodeEvent::CODE_ADDED: {
+            perf_code code = {event->code_len, code_name_for(event)};
+            write_code(event->code_start, code);
+            code_names[event->code_start] = code;
+            break;
+        }
+        case JitCodeEvent::CODE_MOVED: {
+            auto moved = code_names.find(event->code_start);
+            if (moved == code_names.end()) break;
+            perf_code code = moved->second;
+            code_names.erase(moved);
+            write_code(event->new_code_start, code);
+            code_names[event->new_code_start] = code;
+            break;
+        }
+        case JitCodeEvent::CODE_REMOVED:
+            code_names.erase(event->code_start);
+            break;
+        default:
+            break;
+    }
+}
+
+static bool open_perf_map() {
+#ifdef _WIN32
+    PyErr_SetString(PyExc_RuntimeError, "perf maps are only a thing on Linux");
+    return false;
+#else
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int) getpid());
+    // a map left over from an earlier process with the same pid would
+    // confuse perf, but one from earlier in this process is still good
+    perf_map = fopen(path, perf_map_written ? "a" : "w");
+    if (perf_map == NULL) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        return false;
+    }
+    // perf can read the map while the process is still running, so it
+    // shouldn't find half a line at the end
+    setvbuf(perf_map, NULL, _IOLBF, 0);
+    perf_map_written = true;
+    return true;
+#endif
+}
+
+PyObject *enable_perf_map(PyObject *shit, PyObject *noargs) {
+    if (perf_map != NULL) {
+        Py_RETURN_NONE;
+    }
+    if (!open_perf_map()) return NULL;
+    IN_V8;
+    // the existing code is written out right away
+    isolate->SetJitCodeEventHandler(kJitCodeEventEnumExisting, perf_map_event);
+    Py_RETURN_NONE;
+}
+
+PyObject *disable_perf_map(PyObject *shit, PyObject *noargs) {
+    if (perf_map == NULL) {
+        Py_RETURN_NONE;
+    }
+    IN_V8;
+    isolate->SetJitCodeEventHandler(kJitCodeEventDefault, NULL);
+    fclose(perf_map);
+    perf_map = NULL;
+    code_names.clear();
+    script_names.clear();
+    Py_RETURN_NONE;
+}
+
+void perf_map_set_flags() {
+    const char *setting = getenv(PERF_MAP_ENV);
+    if (setting != NULL && strcmp(setting, "jitdump") == 0) {
+        V8::SetFlagsFromString("--perf-prof", strlen("--perf-prof"));
+    }
+}
+
+void perf_map_setup() {
+    const char *setting = getenv(PERF_MAP_ENV);
+    if (setting == NULL || setting[0] == '\0' || strcmp(setting, "0") == 0) {
+        return;
+    }
+    PyObject *result = enable_perf_map(NULL, NULL);
+    if (result == NULL) {
+        // not being able to write the map shouldn't stop anything else
+        PyErr_Print();
+        return;
+    }
+    Py_DECREF(result);
+}
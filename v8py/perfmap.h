@@ -0,0 +1,21 @@
+#ifndef PERFMAP_H
+#define PERFMAP_H
+
+#include <Python.h>
+#include <v8.h>
+
+using namespace v8;
+
+// Writes /tmp/perf-<pid>.map, which is where perf looks for the names of JIT
+// compiled code. JS functions are named after the same script names that
+// tracebacks use.
+PyObject *enable_perf_map(PyObject *shit, PyObject *noargs);
+PyObject *disable_perf_map(PyObject *shit, PyObject *noargs);
+
+// Called before the isolate exists, for what has to be decided then. See
+// V8PY_PERF_MAP in perfmap.cpp.
+void perf_map_set_flags();
+// and after
+void perf_map_setup();
+
+#endif
@@ -22,6 +22,36 @@ inline extern int PyObject_GenericHasAttr(PyObject *obj, PyObject *name) {
     return 1;
 }
 
+// vectorcall went public in 3.9 but works the same way in 3.8
+#if PY_VERSION_HEX >= 0x03090000
+#define HAVE_VECTORCALL
+#elif PY_VERSION_HEX >= 0x03080000
+#define HAVE_VECTORCALL
+#define PyObject_Vectorcall _PyObject_Vectorcall
+#define Py_TPFLAGS_HAVE_VECTORCALL _Py_TPFLAGS_HAVE_VECTORCALL
+#endif
+
+// The lookups PyObject_GenericGetAttr does without running Python code,
+// _PyType_Lookup and _PyObject_GetDictPtr, are private. They've been there
+// since 2.6, so they're only used up to the newest version known to have
+// them, and anything after that goes the slow way.
+#if PY_VERSION_HEX >= 0x02060000 && PY_VERSION_HEX < 0x030E0000
+#define HAVE_TYPE_LOOKUP
+#endif
+
+// the frame accessors went public in 3.9, before that the fields were
+#if PY_VERSION_HEX < 0x03090000
+#include <frameobject.h>
+inline extern PyCodeObject *PyFrame_GetCode(PyFrameObject *frame) {
+    Py_INCREF(frame->f_code);
+    return frame->f_code;
+}
+inline extern PyFrameObject *PyFrame_GetBack(PyFrameObject *frame) {
+    Py_XINCREF(frame->f_back);
+    return frame->f_back;
+}
+#endif
+
 #define PyClass_GET_BASES(cls) (((PyClassObject *) cls)->cl_bases)
 
 inline extern int PyString_StartsWithString(PyObject *str, const char *prefix) {
@@ -0,0 +1,62 @@
+"""A pool of fresh contexts for when every request needs its own sandbox."""
+
+from contextlib import contextmanager
+
+from _v8py import Context
+
+
+class ContextPool(object):
+    """Keeps up to size unused contexts around. setup, if given, is called once
+    with a template context, and every context handed out is a clone of it, so
+    setup should expose things rather than set them from JavaScript (see
+    Context.clone). A released context is reset to a fresh clone and goes back
+    in the pool. It's only closed if the pool is full or the reset fails."""
+
+    def __init__(self, size=4, setup=None, **context_kwargs):
+        self.size = size
+        self.template = Context(**context_kwargs)
+        if setup is not None:
+            setup(self.template)
+        self._free = []
+        self.fill()
+
+    def _create(self):
+        return self.template.clone()
+
+    def fill(self):
+        """Creates contexts until the pool is full. Call this when there's
+        nothing better to do to keep acquire() cheap."""
+        while len(self._free) < self.size:
+            self._free.append(self._create())
+
+    def acquire(self):
+        if self._free:
+            return self._free.pop()
+        return self._create()
+
+    def release(self, context, refill=True):
+        if len(self._free) >= self.size:
+            context.close()
+            return
+        try:
+            context.reset()
+        except Exception:
+            # whatever was left of it can't be handed out again
+            context.close()
+            if refill:
+                self._free.append(self._create())
+        else:
+            self._free.append(context)
+
+    @contextmanager
+    def context(self):
+        context = self.acquire()
+        try:
+            yield context
+        finally:
+            self.release(context)
+
+    def close(self):
+        while self._free:
+            self._free.pop().close()
+        self.template.close()
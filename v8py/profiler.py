@@ -0,0 +1,91 @@
+"""Profile or trace the JavaScript, or the JavaScript and Python together,
+that runs inside a with block."""
+
+import io
+import json
+import warnings
+from contextlib import contextmanager
+
+from _v8py import start_cpu_profiler, stop_cpu_profiler, \
+    start_mixed_profiler, stop_mixed_profiler, start_tracing, stop_tracing
+
+
+class CpuProfile(object):
+    """Filled in with the .cpuprofile dict when the block exits."""
+
+    def __init__(self):
+        self.profile = None
+
+    def save(self, file):
+        """Write the profile to a filename or text file, in a form Chrome's
+        devtools can load."""
+        if isinstance(file, str):
+            with io.open(file, 'w') as f:
+                json.dump(self.profile, f)
+        else:
+            json.dump(self.profile, file)
+
+
+@contextmanager
+def profile_cpu(file=None, sample_interval=1000):
+    """Runs the CPU profiler for the duration of the block. sample_interval is
+    in microseconds. If file is given, the profile gets saved to it."""
+    result = CpuProfile()
+    start_cpu_profiler(sample_interval=sample_interval)
+    try:
+        yield result
+    finally:
+        result.profile = stop_cpu_profiler()
+    if file is not None:
+        result.save(file)
+
+
+class MixedProfile(object):
+    """Filled in with a dict of folded stacks to sample counts when the block
+    exits. Frames in a folded stack are separated by semicolons, outermost
+    first."""
+
+    def __init__(self):
+        self.samples = None
+
+    def save(self, file):
+        """Write the samples to a filename or text file in the folded format
+        that flamegraph.pl and speedscope read."""
+        if isinstance(file, str):
+            with io.open(file, 'w') as f:
+                self.save(f)
+            return
+        for stack, count in sorted(self.samples.items()):
+            file.write(u'%s %d\n' % (stack, count))
+
+
+@contextmanager
+def profile_mixed(file=None, sample_interval=1000):
+    """Samples the Python and JavaScript stacks together for the duration of
+    the block. sample_interval is in microseconds. If file is given, the
+    samples get saved to it."""
+    result = MixedProfile()
+    start_mixed_profiler(sample_interval=sample_interval)
+    try:
+        yield result
+    finally:
+        result.samples = stop_mixed_profiler()
+    if file is not None:
+        result.save(file)
+
+
+@contextmanager
+def trace(file, categories=None):
+    """Writes trace events to the named file for the duration of the block, in
+    the format chrome://tracing and Perfetto load. categories defaults to
+    V8's GC, compile and execution categories and v8py's own. Conversions
+    between Python and JavaScript are in v8py.convert, which isn't on by
+    default."""
+    start_tracing(file, categories)
+    try:
+        yield
+    finally:
+        unfinished = stop_tracing()
+    if unfinished:
+        warnings.warn('%d trace events were written before they finished and '
+                      'have no duration' % unfinished, RuntimeWarning)
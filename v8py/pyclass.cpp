@@ -17,9 +17,45 @@ int py_class_type_init() {
     py_class_type.tp_basicsize = sizeof(py_class);
     py_class_type.tp_flags = Py_TPFLAGS_DEFAULT;
     py_class_type.tp_doc = "";
+    py_class_type.tp_dealloc = (destructor) py_class_dealloc;
     return PyType_Ready(&py_class_type);
 }
 
+static void py_method_free(py_method *method) {
+    convert_plan_free(method->plan);
+    delete method;
+}
+
+static void py_accessor_free(py_accessor *accessor) {
+    Py_DECREF(accessor->name);
+    Py_DECREF(accessor->descriptor);
+    Py_XDECREF(accessor->fget);
+    Py_XDECREF(accessor->fset);
+    delete accessor;
+}
+
+void py_class_dealloc(py_class *self) {
+    if (self->templ != NULL) {
+        self->templ->Reset();
+        delete self->templ;
+    }
+    if (self->methods != NULL) {
+        for (py_method *method : *self->methods) {
+            py_method_free(method);
+        }
+        delete self->methods;
+    }
+    if (self->accessors != NULL) {
+        for (py_accessor *accessor : *self->accessors) {
+            py_accessor_free(accessor);
+        }
+        delete self->accessors;
+    }
+    Py_XDECREF(self->cls);
+    Py_XDECREF(self->cls_name);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
 static PyObject *template_dict = NULL;
 
 PyObject *py_class_to_template(PyObject *cls) {
@@ -43,7 +79,7 @@ PyObject *py_class_to_template(PyObject *cls) {
     return templ;
 }
 
-int add_class_to_template(PyObject *cls, Local<FunctionTemplate> templ);
+int add_class_to_template(py_class *self, PyObject *cls, Local<FunctionTemplate> templ);
 
 PyObject *py_class_new(PyObject *cls) {
     IN_V8;
@@ -64,6 +100,8 @@ PyObject *py_class_new(PyObject *cls) {
 
     py_class *self = (py_class *) py_class_type.tp_alloc(&py_class_type, 0);
     PyErr_PROPAGATE(self);
+    self->methods = new std::vector<py_method *>();
+    self->accessors = new std::vector<py_accessor *>();
 
     Local<External> js_self = External::New(isolate, self);
     ConstructorBehavior construct_allowed = ConstructorBehavior::kAllow;
@@ -81,39 +119,49 @@ PyObject *py_class_new(PyObject *cls) {
     // template. Then recursively do the last one and use it as a superclass.
     for (int i = 0; i < PyTuple_Size(bases) - 1; i++) {
         PyObject *base = PyTuple_GET_ITEM(bases, i);
-        add_class_to_template(base, templ);
+        add_class_to_template(self, base, templ);
     }
-    add_class_to_template(cls, templ);
+    add_class_to_template(self, cls, templ);
 
     templ->InstanceTemplate()->SetInternalFieldCount(OBJECT_INTERNAL_FIELDS);
+
+    self->dynamic_attrs = PyClass_Check(cls) ||
+        ((PyTypeObject *) cls)->tp_getattro != PyObject_GenericGetAttr;
+    self->has_setitem = PyObject_HasAttrString(cls, "__setitem__");
+    self->has_delitem = PyObject_HasAttrString(cls, "__delitem__");
+    self->has_contains = PyObject_HasAttrString(cls, "__contains__");
+    self->unconstructable = PyObject_HasAttrString(cls, "__v8py_unconstructable__");
+    self->error_base = false;
+    bool has_getitem = PyObject_HasAttrString(cls, "__getitem__");
+
     // if the class defines __getitem__ and keys(), it's a mapping.
     // if __setitem__ is implemented, the properties are writable.
     // if __delitem__ is implemented, the properties are configurable.
-    if (PyObject_HasAttrString(cls, "__getitem__") &&
-            PyObject_HasAttrString(cls, "keys")) {
+    if (has_getitem && PyObject_HasAttrString(cls, "keys")) {
         NamedPropertyHandlerConfiguration callbacks;
         callbacks.getter = named_getter;
         callbacks.enumerator = named_enumerator;
         callbacks.query = named_query;
-        if (PyObject_HasAttrString(cls, "__setitem__")) {
+        callbacks.data = js_self;
+        if (self->has_setitem) {
             callbacks.setter = named_setter;
         }
-        if (PyObject_HasAttrString(cls, "__delitem__")) {
+        if (self->has_delitem) {
             callbacks.deleter = named_deleter;
         }
         templ->InstanceTemplate()->SetHandler(callbacks);
     }
     // if __getitem__ and __len__ are defined, it's a sequence.
-    if (PyObject_HasAttrString(cls, "__getitem__") &&
-            PyObject_HasAttrString(cls, "__len__")) {
+    if (has_getitem && PyObject_HasAttrString(cls, "__len__")) {
         IndexedPropertyHandlerConfiguration callbacks;
         callbacks.getter = indexed_getter;
         callbacks.enumerator = indexed_enumerator;
         callbacks.query = indexed_query;
-        if (PyObject_HasAttrString(cls, "__setitem__")) {
+        callbacks.data = js_self;
+        if (self->has_setitem) {
             callbacks.setter = indexed_setter;
         }
-        if (PyObject_HasAttrString(cls, "__delitem__")) {
+        if (self->has_delitem) {
             callbacks.deleter = indexed_deleter;
         }
         templ->InstanceTemplate()->SetHandler(callbacks);
@@ -142,17 +190,20 @@ PyObject *py_class_new(PyObject *cls) {
         // it has to be a magic count instead of a field because you can't set an internal field on a template
         // only an object
         templ->PrototypeTemplate()->Set(JSTR("__proto__"), I_CAN_HAZ_ERROR_PROTOTYPE);
+        self->error_base = true;
     } else if (last_base != NULL && last_base != (PyObject *) &PyBaseObject_Type) {
         py_class *superclass_templ = (py_class *) py_class_to_template(last_base);
         templ->Inherit(superclass_templ->templ->Get(isolate));
+        self->error_base = superclass_templ->error_base;
     }
 
     return (PyObject *) self;
 }
 
-int add_to_template(PyObject *cls, PyObject *member_name, PyObject *member_value, Local<FunctionTemplate> templ);
+int add_to_template(py_class *self, PyObject *cls, PyObject *member_name, PyObject *member_value, Local<FunctionTemplate> templ);
 
-int add_class_to_template(PyObject *cls, Local<FunctionTemplate> templ) {
+// self is the class the template belongs to, which cls is or is a base of
+int add_class_to_template(py_class *self, PyObject *cls, Local<FunctionTemplate> templ) {
     PyObject *dict;
     if (PyClass_Check(cls)) {
         // old style
@@ -176,7 +227,7 @@ int add_class_to_template(PyObject *cls, Local<FunctionTemplate> templ) {
     while (PyDict_Next(dict, &pos, &member_name, &member_value)) {
         Py_INCREF(member_name);
         Py_INCREF(member_value);
-        if (add_to_template(cls, member_name, member_value, templ) < 0) {
+        if (add_to_template(self, cls, member_name, member_value, templ) < 0) {
             Py_DECREF(dict);
             return -1;
         }
@@ -193,8 +244,54 @@ bool if_property_has(PyObject *property, const char *what) {
     return value == Py_None;
 }
 
+static py_accessor *py_accessor_new(PyObject *cls, PyObject *name, PyObject *descriptor) {
+    py_accessor *accessor = new py_accessor;
+    accessor->kind = ACCESSOR_GENERIC;
+    Py_INCREF(name);
+    accessor->name = name;
+    Py_INCREF(descriptor);
+    accessor->descriptor = descriptor;
+    accessor->owner = NULL;
+    accessor->fget = accessor->fset = NULL;
+
+    // only data descriptors win over the instance dict, so those are the
+    // only ones that are safe to call without looking at the instance
+    if (!PyType_Check(cls)) {
+        return accessor;
+    }
+    accessor->owner = (PyTypeObject *) cls;
+    if (PyObject_TypeCheck(descriptor, &PyMemberDescr_Type)) {
+        accessor->kind = ACCESSOR_MEMBER;
+    } else if (PyObject_TypeCheck(descriptor, &PyProperty_Type)) {
+        PyObject *fget = PyObject_GetAttrString(descriptor, "fget");
+        PyObject *fset = PyObject_GetAttrString(descriptor, "fset");
+        if (fget == NULL || fset == NULL) {
+            // fall back to getattr, which will have the same problem
+            PyErr_Clear();
+            Py_XDECREF(fget);
+            Py_XDECREF(fset);
+            return accessor;
+        }
+        // a missing fget or fset is left to getattr/setattr to complain about
+        if (fget == Py_None) {
+            Py_DECREF(fget);
+            fget = NULL;
+        }
+        if (fset == Py_None) {
+            Py_DECREF(fset);
+            fset = NULL;
+        }
+        accessor->kind = ACCESSOR_PROPERTY;
+        accessor->fget = fget;
+        accessor->fset = fset;
+    } else if (Py_TYPE(descriptor)->tp_descr_get != NULL && Py_TYPE(descriptor)->tp_descr_set != NULL) {
+        accessor->kind = ACCESSOR_DESCRIPTOR;
+    }
+    return accessor;
+}
+
 // 0 on success, -1 on failure
-int add_to_template(PyObject *cls, PyObject *member_name, PyObject *member_value, Local<FunctionTemplate> templ) {
+int add_to_template(py_class *self, PyObject *cls, PyObject *member_name, PyObject *member_value, Local<FunctionTemplate> templ) {
     HandleScope hs(isolate);
     Local<Context> no_ctx;
     Local<Signature> sig = Signature::New(isolate, templ);
@@ -211,8 +308,12 @@ int add_to_template(PyObject *cls, PyObject *member_name, PyObject *member_value
 
     if (PyFunction_Check(member_value)) {
         // if it's an unbound method, create a method
-        // the member value is supposed to be not increfed because the class should hold a reference to it
-        Local<External> js_method = External::New(isolate, member_value);
+        // like templates, these live as long as the class does
+        py_method *method = new py_method();
+        method->function = member_value;
+        method->plan = convert_plan_new(member_value, true);
+        self->methods->push_back(method);
+        Local<External> js_method = External::New(isolate, method);
         js_value = FunctionTemplate::New(isolate, py_class_method_callback, js_method, sig);
     } else {
         if (PyObject_TypeCheck(member_value, &PyStaticMethod_Type) ||
@@ -234,8 +335,10 @@ int add_to_template(PyObject *cls, PyObject *member_name, PyObject *member_value
             if (!PyObject_HasAttrString(member_value, "__del__") || if_property_has(member_value, "fdel")) {
                 attributes |= DontDelete;
             }
+            py_accessor *accessor = py_accessor_new(cls, member_name, member_value);
+            self->accessors->push_back(accessor);
             templ->InstanceTemplate()->SetAccessor(js_name, py_class_property_getter, py_class_property_setter, 
-                    js_name, DEFAULT, static_cast<PropertyAttribute>(attributes));
+                    External::New(isolate, accessor), DEFAULT, static_cast<PropertyAttribute>(attributes));
         } else {
             // otherwise just convert
             js_value = js_from_py(member_value, no_ctx);
@@ -259,43 +362,140 @@ Local<Function> py_class_get_constructor(py_class *self, Local<Context> context)
     return hs.Escape(function);
 }
 
-void py_class_object_weak_callback(const WeakCallbackInfo<Persistent<Object>> &info) {
-    HandleScope hs(isolate);
-    Local<Object> js_object = info.GetParameter()->Get(isolate);
-    assert(js_object->GetInternalField(0) == IZ_DAT_OBJECT);
-    PyObject *py_object = (PyObject *) js_object->GetInternalField(1).As<External>()->Value();
+// Wrappers get made and collected constantly, so they're carved out of big
+// blocks and recycled through a free list instead of going through new and
+// delete every time. The blocks are never given back.
+#define WRAPPER_BLOCK_SIZE 1024
+static py_wrapper *free_wrappers = NULL;
+
+static py_wrapper *wrapper_alloc() {
+    if (free_wrappers == NULL) {
+        py_wrapper *block = new py_wrapper[WRAPPER_BLOCK_SIZE];
+        for (int i = 0; i < WRAPPER_BLOCK_SIZE - 1; i++) {
+            block[i].next = &block[i + 1];
+        }
+        block[WRAPPER_BLOCK_SIZE - 1].next = NULL;
+        free_wrappers = block;
+    }
+    py_wrapper *wrapper = free_wrappers;
+    free_wrappers = wrapper->next;
+    wrapper->next = NULL;
+    return wrapper;
+}
 
-    // the entire purpose of this weak callback
-    Py_DECREF(py_object);
+// the handle must have been reset already
+static void wrapper_free(py_wrapper *wrapper) {
+    wrapper->py_object = NULL;
+    wrapper->context = NULL;
+    wrapper->prev = NULL;
+    wrapper->next = free_wrappers;
+    free_wrappers = wrapper;
+}
 
-    info.GetParameter()->Reset();
-    delete info.GetParameter();
+static void wrapper_unlink(py_wrapper *wrapper) {
+    if (wrapper->context != NULL) {
+        // the same Python object can end up with more than one wrapper if
+        // its constructor returns an existing object, so only take out the
+        // cache entry if it's this one
+        auto cached = wrapper->context->js_object_cache->find(wrapper->py_object);
+        if (cached != wrapper->context->js_object_cache->end() && cached->second == wrapper) {
+            wrapper->context->js_object_cache->erase(cached);
+        }
+    }
+    if (wrapper->prev != NULL) {
+        wrapper->prev->next = wrapper->next;
+    } else if (wrapper->context != NULL) {
+        wrapper->context->wrappers = wrapper->next;
+    }
+    if (wrapper->next != NULL) {
+        wrapper->next->prev = wrapper->prev;
+    }
+    wrapper->prev = wrapper->next = NULL;
 }
 
-void py_class_init_js_object(Local<Object> js_object, PyObject *py_object, Local<Context> context) {
-    js_object->SetInternalField(0, IZ_DAT_OBJECT);
-    js_object->SetInternalField(1, External::New(isolate, py_object));
+void py_class_object_weak_callback(const WeakCallbackInfo<py_wrapper> &info) {
+    py_wrapper *wrapper = info.GetParameter();
 
-    // find out if the object is supposed to inherit from Error
-    // the information is in an internal field on the last prototype
+    // the entire purpose of this weak callback
+    Py_DECREF(wrapper->py_object);
+
+    wrapper_unlink(wrapper);
+    wrapper->handle.Reset();
+    wrapper_free(wrapper);
+}
+
+// The magic property on the last prototype gets replaced with Error.prototype
+// the first time an object of the class is made in a context. After that the
+// chain ends at Error.prototype and there's nothing to do.
+static void fix_error_prototype(Local<Object> js_object, Local<Context> context) {
+    Local<Value> object_prototype = context->GetEmbedderData(OBJECT_PROTOTYPE_SLOT);
+    Local<Value> error_prototype = context->GetEmbedderData(ERROR_PROTOTYPE_SLOT);
     Local<Value> last_proto = js_object;
     Local<Object> last_proto_object;
-    while (!last_proto->StrictEquals(context->GetEmbedderData(OBJECT_PROTOTYPE_SLOT))) {
+    while (!last_proto->StrictEquals(object_prototype)) {
+        if (last_proto->StrictEquals(error_prototype)) {
+            return;
+        }
         last_proto_object = last_proto.As<Object>();
         last_proto = last_proto_object->GetPrototype();
     }
-    // last_proto is guaranteed to have a value because the loop is guaranteed
-    // to run at least once because last_proto_chain is initialized to js_object
-    assert(!last_proto.IsEmpty());
-    if (last_proto_object->Get(context, JSTR("__proto__")).ToLocalChecked()->StrictEquals(I_CAN_HAZ_ERROR_PROTOTYPE)) {
-        last_proto_object->Delete(context, JSTR("__proto__")).FromJust();
-        last_proto_object->SetPrototype(context->GetEmbedderData(ERROR_PROTOTYPE_SLOT));
+    // last_proto_object is guaranteed to have a value because the loop is
+    // guaranteed to run at least once because last_proto is initialized to
+    // js_object
+    assert(!last_proto_object.IsEmpty());
+    Local<String> proto_key = JSTR("__proto__");
+    if (last_proto_object->Get(context, proto_key).ToLocalChecked()->StrictEquals(I_CAN_HAZ_ERROR_PROTOTYPE)) {
+        last_proto_object->Delete(context, proto_key).FromJust();
+        last_proto_object->SetPrototype(error_prototype);
+    }
+}
+
+void py_class_init_js_object(Local<Object> js_object, PyObject *py_object, Local<Context> context, py_class *cls) {
+    js_object->SetInternalField(0, IZ_DAT_OBJECT);
+    js_object->SetInternalField(1, External::New(isolate, py_object));
+
+    // find out if the object is supposed to inherit from Error
+    if (cls == NULL || cls->error_base) {
+        fix_error_prototype(js_object, context);
+    }
+
+    context_c *ctx_c = (context_c *) context->GetEmbedderData(CONTEXT_OBJECT_SLOT).As<External>()->Value();
+    py_wrapper *wrapper = wrapper_alloc();
+    wrapper->handle.Reset(isolate, js_object);
+    wrapper->handle.SetWeak(wrapper, py_class_object_weak_callback, WeakCallbackType::kFinalizer);
+    wrapper->py_object = py_object;
+    wrapper->context = ctx_c;
+    wrapper->prev = NULL;
+    wrapper->next = ctx_c->wrappers;
+    if (ctx_c->wrappers != NULL) {
+        ctx_c->wrappers->prev = wrapper;
     }
+    ctx_c->wrappers = wrapper;
 
-    Persistent<Object> *obj_handle = new Persistent<Object>(isolate, js_object);
-    obj_handle->SetWeak(obj_handle, py_class_object_weak_callback, WeakCallbackType::kFinalizer);
+    context_set_cached_jsobject(context, py_object, wrapper);
+}
+
+void py_class_release_wrappers(context_c *context) {
+    HandleScope hs(isolate);
+    while (context->wrappers != NULL) {
+        py_wrapper *wrapper = context->wrappers;
+        wrapper_unlink(wrapper);
+        // if something still has the JS object, it gets None instead of a
+        // dangling pointer. None doesn't need a reference.
+        Local<Object> js_object = wrapper->handle.Get(isolate);
+        js_object->SetInternalField(1, External::New(isolate, Py_None));
+        wrapper->handle.Reset();
+        Py_DECREF(wrapper->py_object);
+        wrapper_free(wrapper);
+    }
+}
 
-    context_set_cached_jsobject(context, py_object, js_object);
+void py_class_orphan_wrappers(context_c *context) {
+    while (context->wrappers != NULL) {
+        py_wrapper *wrapper = context->wrappers;
+        wrapper_unlink(wrapper);
+        wrapper->context = NULL;
+    }
 }
 
 Local<Object> py_class_create_js_object(py_class *self, PyObject *py_object, Local<Context> context) {
@@ -308,7 +508,7 @@ Local<Object> py_class_create_js_object(py_class *self, PyObject *py_object, Loc
 
     object = self->templ->Get(isolate)->InstanceTemplate()->NewInstance(context).ToLocalChecked();
     Py_INCREF(py_object);
-    py_class_init_js_object(object, py_object, context);
+    py_class_init_js_object(object, py_object, context, self);
 
     return hs.Escape(object);
 }
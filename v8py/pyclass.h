@@ -2,14 +2,70 @@
 #define CLASS_TEMPLATE_H
 
 #include <Python.h>
+#include <vector>
+
+#include "convert.h"
 
 using namespace v8;
 
+// One of these exists for every JS object that wraps a Python object. The
+// handle is weak, and when the JS object is collected the Python object gets
+// decref'd. It's also linked into the list of wrappers on the context the
+// object was created in.
+typedef struct py_wrapper {
+    Persistent<Object> handle;
+    PyObject *py_object;
+    struct _context *context;
+    struct py_wrapper *prev;
+    struct py_wrapper *next;
+} py_wrapper;
+
+// Callback data for a method. The function isn't increfed because the class
+// holds a reference to it.
+typedef struct {
+    PyObject *function;
+    convert_plan *plan;
+} py_method;
+
+enum accessor_kind {
+    ACCESSOR_GENERIC,    // plain getattr/setattr
+    ACCESSOR_MEMBER,     // __slots__ member, read straight out of the object
+    ACCESSOR_PROPERTY,   // property, call fget/fset directly
+    ACCESSOR_DESCRIPTOR, // some other data descriptor, call __get__/__set__
+};
+
+// Accessor data for a descriptor on a class. The descriptor is resolved when
+// the template is built so getting and setting doesn't have to convert the
+// name and walk the MRO every time. owner is the class it was found on.
+typedef struct {
+    enum accessor_kind kind;
+    PyObject *name;
+    PyObject *descriptor;
+    PyTypeObject *owner;
+    PyObject *fget;
+    PyObject *fset;
+} py_accessor;
+
 typedef struct {
     PyObject_HEAD
     PyObject *cls;
     PyObject *cls_name;
     Persistent<FunctionTemplate> *templ;
+    // the callback data of the template's methods and accessors
+    std::vector<py_method *> *methods;
+    std::vector<py_accessor *> *accessors;
+
+    // Worked out once in py_class_new so the interceptors, which get this as
+    // their data, don't have to ask Python on every property access.
+    // dynamic_attrs is set if the class does its own attribute lookup, so
+    // only asking it will do.
+    bool dynamic_attrs;
+    bool has_setitem;
+    bool has_delitem;
+    bool has_contains;
+    // looked up once so construction doesn't have to
+    bool unconstructable;
+    bool error_base;
 } py_class;
 int py_class_type_init();
 extern PyTypeObject py_class_type;
@@ -19,7 +75,12 @@ PyObject *py_class_new(PyObject *cls);
 PyObject *py_class_to_template(PyObject *cls);
 Local<Function> py_class_get_constructor(py_class *self, Local<Context> context);
 Local<Object> py_class_create_js_object(py_class *self, PyObject *py_object, Local<Context> context);
-void py_class_init_js_object(Local<Object> js_object, PyObject *py_object, Local<Context> context);
+// cls is the class the object was made from, or NULL if that's not known
+void py_class_init_js_object(Local<Object> js_object, PyObject *py_object, Local<Context> context, py_class *cls = NULL);
+// drop the Python references held by every wrapper in the context right now
+void py_class_release_wrappers(struct _context *context);
+// stop the wrappers from pointing at a context that's going away
+void py_class_orphan_wrappers(struct _context *context);
 
 // first one is magic pointer
 // second one is actual object
@@ -1,12 +1,18 @@
 #include <v8.h>
 #include <Python.h>
+#include <structmember.h>
 
 #include "v8py.h"
 #include "convert.h"
 #include "pyclass.h"
+#include "stats.h"
+#include "mixedprofiler.h"
+#include "tracing.h"
+#include "hooks.h"
 
 void py_class_construct_callback(const FunctionCallbackInfo<Value> &info) {
     HandleScope hs(isolate);
+    TRACE_EVENT(trace_v8py, "Python constructor");
     py_class *self = (py_class *) info.Data().As<External>()->Value();
     Local<Context> context = isolate->GetCurrentContext();
 
@@ -14,7 +20,7 @@ void py_class_construct_callback(const FunctionCallbackInfo<Value> &info) {
         isolate->ThrowException(Exception::TypeError(JSTR("Constructor requires 'new' operator")));
         return;
     }
-    if (PyObject_HasAttrString(self->cls, "__v8py_unconstructable__")) {
+    if (self->unconstructable) {
         PyObject *format_args = Py_BuildValue("O", self->cls_name);
         JS_PROPAGATE_PY(format_args);
         PyObject *format_string = PyUnicode_FromString("%s is not a constructor");
@@ -24,18 +30,55 @@ void py_class_construct_callback(const FunctionCallbackInfo<Value> &info) {
             return;
         }
         PyObject *message = PyUnicode_Format(format_string, format_args);
+        Py_DECREF(format_string);
+        Py_DECREF(format_args);
         JS_PROPAGATE_PY(message);
         isolate->ThrowException(Exception::TypeError(js_from_py(message, context).As<String>()));
+        Py_DECREF(message);
+        return;
     }
 
     Local<Object> js_new_object = info.Holder();
-    PyObject *new_object = PyObject_Call(self->cls, pys_from_jss(info, context), NULL);
+#ifdef HAVE_VECTORCALL
+    int argc = info.Length();
+    // slot 0 is scratch space for the callee, see PY_VECTORCALL_ARGUMENTS_OFFSET
+    PyObject *args_stack[ARGS_STACK_SIZE + 1];
+    PyObject **args = argc <= ARGS_STACK_SIZE ? args_stack : new PyObject *[argc + 1];
+    if (pys_from_jss_array(info, &args[1], context) < 0) {
+        if (args != args_stack) delete[] args;
+        js_throw_py();
+        return;
+    }
+    HOOK_CALLBACK(HOOK_CALLBACK_ENTER, self->cls);
+    MIXED_PROFILER_ENTER;
+    STATS_START(context);
+    PyObject *new_object = PyObject_Vectorcall(self->cls, &args[1], argc | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
+    STATS_STOP(callbacks, callback_time);
+    MIXED_PROFILER_EXIT;
+    HOOK_CALLBACK(HOOK_CALLBACK_EXIT, self->cls);
+    for (int i = 0; i < argc; i++) {
+        Py_DECREF(args[i + 1]);
+    }
+    if (args != args_stack) delete[] args;
+#else
+    PyObject *args = pys_from_jss(info, context);
+    JS_PROPAGATE_PY(args);
+    HOOK_CALLBACK(HOOK_CALLBACK_ENTER, self->cls);
+    MIXED_PROFILER_ENTER;
+    STATS_START(context);
+    PyObject *new_object = PyObject_Call(self->cls, args, NULL);
+    STATS_STOP(callbacks, callback_time);
+    MIXED_PROFILER_EXIT;
+    HOOK_CALLBACK(HOOK_CALLBACK_EXIT, self->cls);
+    Py_DECREF(args);
+#endif
     JS_PROPAGATE_PY(new_object);
-    py_class_init_js_object(js_new_object, new_object, context);
+    py_class_init_js_object(js_new_object, new_object, context, self);
 }
 
 void py_class_method_callback(const FunctionCallbackInfo<Value> &info) {
     HandleScope hs(isolate);
+    TRACE_EVENT(trace_v8py, "Python method");
     Local<Context> context = isolate->GetCurrentContext();
 
     Local<Object> js_self = info.Holder();
@@ -43,31 +86,66 @@ void py_class_method_callback(const FunctionCallbackInfo<Value> &info) {
         js_self = js_self->GetPrototype().As<Object>();
     }
     PyObject *self = (PyObject *) js_self->GetInternalField(1).As<External>()->Value();
-    PyObject *args = pys_from_jss(info, context);
-    JS_PROPAGATE_PY(args);
-    // add self onto the beginning of the arg list
-    PyObject *all_args = PyTuple_New(PyTuple_Size(args) + 1);
-    Py_INCREF(self);
-    PyTuple_SetItem(all_args, 0, self);
-    for (int i = 0; i < PyTuple_Size(args); i++) {
-        PyObject *arg = PyTuple_GetItem(args, i);
-        Py_INCREF(arg);
-        PyTuple_SetItem(all_args, i + 1, arg);
-    }
-    Py_DECREF(args);
+    py_method *method = (py_method *) info.Data().As<External>()->Value();
+    assert(PyFunction_Check(method->function));
+    int argc = info.Length();
 
-    PyObject *method = (PyObject *) info.Data().As<External>()->Value();
-    if (method == NULL) {
+#ifdef HAVE_VECTORCALL
+    // the first slot is left empty so the callee is allowed to use it (that's
+    // what PY_VECTORCALL_ARGUMENTS_OFFSET means), then self, then the args
+    PyObject *args_stack[ARGS_STACK_SIZE + 2];
+    PyObject **args = argc <= ARGS_STACK_SIZE ? args_stack : new PyObject *[argc + 2];
+    args[1] = self;
+    if (pys_from_jss_array(info, &args[2], context, method->plan) < 0) {
+        if (args != args_stack) delete[] args;
+        js_throw_py();
+        return;
+    }
+    HOOK_CALLBACK(HOOK_CALLBACK_ENTER, method->function);
+    MIXED_PROFILER_ENTER;
+    STATS_START(context);
+    PyObject *retval = PyObject_Vectorcall(method->function, &args[1], (argc + 1) | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
+    STATS_STOP(callbacks, callback_time);
+    MIXED_PROFILER_EXIT;
+    HOOK_CALLBACK(HOOK_CALLBACK_EXIT, method->function);
+    for (int i = 0; i < argc; i++) {
+        Py_DECREF(args[i + 2]);
+    }
+    if (args != args_stack) delete[] args;
+#else
+    // convert straight into the tuple, after self
+    PyObject *all_args = PyTuple_New(argc + 1);
+    JS_PROPAGATE_PY(all_args);
+    Py_INCREF(self);
+    PyTuple_SET_ITEM(all_args, 0, self);
+    if (pys_from_jss_array(info, &PyTuple_GET_ITEM(all_args, 1), context, method->plan) < 0) {
         Py_DECREF(all_args);
         js_throw_py();
         return;
     }
-    assert(PyFunction_Check(method));
-    PyObject *retval = PyObject_Call(method, all_args, NULL);
+    HOOK_CALLBACK(HOOK_CALLBACK_ENTER, method->function);
+    MIXED_PROFILER_ENTER;
+    STATS_START(context);
+    PyObject *retval = PyObject_Call(method->function, all_args, NULL);
+    STATS_STOP(callbacks, callback_time);
+    MIXED_PROFILER_EXIT;
+    HOOK_CALLBACK(HOOK_CALLBACK_EXIT, method->function);
     Py_DECREF(all_args);
+#endif
 
     JS_PROPAGATE_PY(retval);
-    info.GetReturnValue().Set(js_from_py(retval, context));
+    Local<Value> js_retval;
+    if (method->plan != NULL) {
+        js_retval = js_from_py_planned(method->plan->ret, retval, context);
+        if (js_retval.IsEmpty()) {
+            Py_DECREF(retval);
+            js_throw_py();
+            return;
+        }
+    } else {
+        js_retval = js_from_py(retval, context);
+    }
+    info.GetReturnValue().Set(js_retval);
     Py_DECREF(retval);
 }
 
@@ -82,6 +160,33 @@ template <class T> inline extern PyObject *get_self(const PropertyCallbackInfo<T
     return (PyObject *) js_self->GetInternalField(1).template As<External>()->Value();
 }
 
+// the interceptors get the class's py_class as their data
+template <class T> inline extern py_class *get_class(const PropertyCallbackInfo<T> &info) {
+    return (py_class *) info.Data().template As<External>()->Value();
+}
+
+// Same answer as PyObject_HasAttr for the usual case of a class that doesn't
+// override attribute lookup, without running any Python code: the type's
+// attribute cache, which is thrown out whenever the class or one of its bases
+// changes, and then the instance dict.
+static inline bool has_attr(py_class *cls, PyObject *self, PyObject *key) {
+#ifdef HAVE_TYPE_LOOKUP
+    if (cls->dynamic_attrs) {
+        return PyObject_HasAttr(self, key);
+    }
+    if (!PyUnicode_Check(key) && !PyString_Check(key)) {
+        return false;
+    }
+    if (_PyType_Lookup(Py_TYPE(self), key) != NULL) {
+        return true;
+    }
+    PyObject **dict = _PyObject_GetDictPtr(self);
+    return dict != NULL && *dict != NULL && PyDict_GetItem(*dict, key) != NULL;
+#else
+    return PyObject_HasAttr(self, key);
+#endif
+}
+
 #define Info(T) const PropertyCallbackInfo<T> &info
 
 // getter
@@ -104,37 +209,26 @@ template <class T> inline extern PyObject *get_self(const PropertyCallbackInfo<T
     Py_DECREF(name); \
 }
 
-#define INDEXED(code) { \
-    PyObject *idx = PyLong_FromSize_t(index); \
-    JS_PROPAGATE_PY(idx); \
-    code; \
-    Py_DECREF(idx); \
-}
-
 #define SETUP \
     HandleScope hs(isolate); \
     Local<Context> context = isolate->GetCurrentContext();
 #define CHECK_ATTR \
-    if (PyObject_HasAttr(get_self(info), key)) { \
+    if (has_attr(get_class(info), get_self(info), key)) { \
         return; \
     }
 
 void getter_callback(PyObject *key, Info(Value)) {
+    MIXED_PROFILER_SCOPE;
     SETUP; CHECK_ATTR;
-    if (PyIndex_Check(key) && PyNumber_AsSsize_t(key, NULL) >= PyObject_Size(get_self(info))) {
-        // index out of bounds
-        return;
-    }
-
     PyObject *value = PyObject_GetItem(get_self(info), key);
     JS_PROPAGATE_PY(value);
     info.GetReturnValue().Set(js_from_py(value, context));
     Py_DECREF(value);
 }
 void named_getter(Local<Name> js_name, Info(Value)) NAMED(getter_callback(name, info))
-void indexed_getter(uint32_t index, Info(Value)) INDEXED(getter_callback(idx, info))
 
 void setter_callback(PyObject *key, Local<Value> js_value, Info(Value)) {
+    MIXED_PROFILER_SCOPE;
     SETUP; CHECK_ATTR;
     PyObject *value = py_from_js(js_value, context);
     JS_PROPAGATE_PY(value);
@@ -147,9 +241,9 @@ void setter_callback(PyObject *key, Local<Value> js_value, Info(Value)) {
     Py_DECREF(value);
 }
 void named_setter(Local<Name> js_name, Local<Value> value, Info(Value)) NAMED(setter_callback(name, value, info))
-void indexed_setter(uint32_t index, Local<Value> value, Info(Value)) INDEXED(setter_callback(idx, value, info))
 
 void deleter_callback(PyObject *key, Info(Boolean)) {
+    MIXED_PROFILER_SCOPE;
     CHECK_ATTR;
     if (PyObject_DelItem(get_self(info), key) < 0) {
         if (info.ShouldThrowOnError()) {
@@ -162,44 +256,48 @@ void deleter_callback(PyObject *key, Info(Boolean)) {
     }
 }
 void named_deleter(Local<Name> js_name, Info(Boolean)) NAMED(deleter_callback(name, info))
-void indexed_deleter(uint32_t index, Info(Boolean)) INDEXED(deleter_callback(idx, info))
+
+// property attributes for items, which are the same for every item
+static inline int item_attributes(py_class *cls) {
+    int attributes = DontEnum;
+    if (!cls->has_setitem) {
+        attributes |= ReadOnly;
+    }
+    if (!cls->has_delitem) {
+        attributes |= DontDelete;
+    }
+    return attributes;
+}
 
 void query_callback(PyObject *key, Info(Integer)) {
+    MIXED_PROFILER_SCOPE;
     CHECK_ATTR;
 
+    py_class *cls = get_class(info);
     PyObject *self = get_self(info);
-    if (PyIndex_Check(key)) {
-        // check for out of bounds index
-        if (PyNumber_AsSsize_t(key, NULL) >= PyObject_Size(self)) {
-            return;
-        }
+    // check for no such key
+    int contains;
+    if (cls->has_contains) {
+        contains = PySequence_Contains(self, key);
     } else {
-        // check for no such attribute
-        PyObject *keys = PyObject_CallMethod(get_self(info), "keys", "");
+        PyObject *keys = PyObject_CallMethod(self, (char *) "keys", (char *) "");
         JS_PROPAGATE_PY(keys);
-        switch (PySequence_Contains(keys, key)) {
-            case -1:
-                js_throw_py();
-                // intentional fall-through
-            case 0:
-                return;
-        }
-    }
-
-    int descriptor = DontEnum;
-    PyObject *cls = (PyObject *) Py_TYPE(self);
-    if (!PyObject_HasAttrString(cls, "__setitem__")) {
-        descriptor |= ReadOnly;
+        contains = PySequence_Contains(keys, key);
+        Py_DECREF(keys);
     }
-    if (!PyObject_HasAttrString(cls, "__delitem__")) {
-        descriptor |= DontDelete;
+    switch (contains) {
+        case -1:
+            js_throw_py();
+            // intentional fall-through
+        case 0:
+            return;
     }
-    info.GetReturnValue().Set(descriptor);
+    info.GetReturnValue().Set(item_attributes(cls));
 }
 void named_query(Local<Name> js_name, Info(Integer)) NAMED(query_callback(name, info))
-void indexed_query(uint32_t index, Info(Integer)) INDEXED(query_callback(idx, info))
 
 void named_enumerator(Info(Array)) {
+    MIXED_PROFILER_SCOPE;
     SETUP;
     PyObject *keys = PyObject_CallMethod(get_self(info), "keys", "");
     JS_PROPAGATE_PY(keys);
@@ -215,39 +313,203 @@ void named_enumerator(Info(Array)) {
     }
     info.GetReturnValue().Set(js_keys);
 }
+
+// --- Indexed interceptors ---
+// An index is never an attribute name, so these skip the attribute check and
+// hand the C index straight to the sequence slots, which is what __getitem__
+// and friends fill in for Python classes. Only types without the slots need
+// an int object.
+
+// Lists and tuples, as long as __getitem__ is still theirs, can be read
+// straight out of their item arrays.
+static inline bool has_fast_items(PyObject *self) {
+    PySequenceMethods *sequence = Py_TYPE(self)->tp_as_sequence;
+    return (PyList_Check(self) && sequence->sq_item == PyList_Type.tp_as_sequence->sq_item)
+        || (PyTuple_Check(self) && sequence->sq_item == PyTuple_Type.tp_as_sequence->sq_item);
+}
+
+// Returns NULL without an exception if there's nothing at index. sq_item
+// raises IndexError past the end, so the length is only needed for types
+// without it.
+static inline PyObject *sequence_get_item(PyObject *self, Py_ssize_t index) {
+    if (has_fast_items(self)) {
+        if (index >= PySequence_Fast_GET_SIZE(self)) {
+            return NULL;
+        }
+        PyObject *value = PySequence_Fast_GET_ITEM(self, index);
+        Py_INCREF(value);
+        return value;
+    }
+    PySequenceMethods *sequence = Py_TYPE(self)->tp_as_sequence;
+    if (sequence != NULL && sequence->sq_item != NULL) {
+        PyObject *value = sequence->sq_item(self, index);
+        if (value == NULL && PyErr_ExceptionMatches(PyExc_IndexError)) {
+            PyErr_Clear();
+        }
+        return value;
+    }
+    Py_ssize_t length = PyObject_Size(self);
+    if (length < 0 || index >= length) return NULL;
+    PyObject *key = PyLong_FromSsize_t(index);
+    PyErr_PROPAGATE(key);
+    PyObject *value = PyObject_GetItem(self, key);
+    Py_DECREF(key);
+    return value;
+}
+
+// value is NULL to delete
+static inline int sequence_set_item(PyObject *self, Py_ssize_t index, PyObject *value) {
+    PySequenceMethods *sequence = Py_TYPE(self)->tp_as_sequence;
+    if (sequence != NULL && sequence->sq_ass_item != NULL) {
+        return sequence->sq_ass_item(self, index, value);
+    }
+    PyObject *key = PyLong_FromSsize_t(index);
+    PyErr_PROPAGATE_(key);
+    int result = value != NULL ? PyObject_SetItem(self, key, value) : PyObject_DelItem(self, key);
+    Py_DECREF(key);
+    return result;
+}
+
+void indexed_getter(uint32_t index, Info(Value)) {
+    MIXED_PROFILER_SCOPE;
+    SETUP;
+    PyObject *value = sequence_get_item(get_self(info), index);
+    if (value == NULL) {
+        if (PyErr_Occurred()) js_throw_py();
+        return;
+    }
+    info.GetReturnValue().Set(js_from_py(value, context));
+    Py_DECREF(value);
+}
+
+void indexed_setter(uint32_t index, Local<Value> js_value, Info(Value)) {
+    MIXED_PROFILER_SCOPE;
+    SETUP;
+    PyObject *value = py_from_js(js_value, context);
+    JS_PROPAGATE_PY(value);
+    int result = sequence_set_item(get_self(info), index, value);
+    Py_DECREF(value);
+    JS_PROPAGATE_PY_(result);
+    info.GetReturnValue().Set(js_value);
+}
+
+void indexed_deleter(uint32_t index, Info(Boolean)) {
+    MIXED_PROFILER_SCOPE;
+    if (sequence_set_item(get_self(info), index, NULL) < 0) {
+        PyErr_Clear();
+        if (info.ShouldThrowOnError()) {
+            isolate->ThrowException(Exception::TypeError(JSTR("Unable to delete property.")));
+            return;
+        }
+        info.GetReturnValue().Set(False(isolate));
+    } else {
+        info.GetReturnValue().Set(True(isolate));
+    }
+}
+
+void indexed_query(uint32_t index, Info(Integer)) {
+    MIXED_PROFILER_SCOPE;
+    PyObject *value = sequence_get_item(get_self(info), index);
+    if (value == NULL) {
+        if (PyErr_Occurred()) js_throw_py();
+        return;
+    }
+    Py_DECREF(value);
+    info.GetReturnValue().Set(item_attributes(get_class(info)));
+}
+
 void indexed_enumerator(Info(Array)) {
+    MIXED_PROFILER_SCOPE;
     SETUP;
     Py_ssize_t length = PyObject_Size(get_self(info));
-    if (length < 0) {
-        js_throw_py();
-    }
+    JS_PROPAGATE_PY_(length);
     Local<Array> keys = Array::New(isolate, length);
-    for (int i = 0; i < length; i++) {
-        keys->Set(context, i, Integer::New(isolate, i));
+    for (Py_ssize_t i = 0; i < length; i++) {
+        // nothing can be in the way on a fresh array, so skip the setter lookup
+        keys->CreateDataProperty(context, i, Integer::New(isolate, i)).FromJust();
     }
     info.GetReturnValue().Set(keys);
 }
 
+// The descriptor can only be used directly if it's what the object's type
+// would find. A subclass might have replaced it.
+static inline bool accessor_applies(py_accessor *accessor, PyObject *self) {
+    PyTypeObject *type = Py_TYPE(self);
+#ifdef HAVE_TYPE_LOOKUP
+    return type == accessor->owner || _PyType_Lookup(type, accessor->name) == accessor->descriptor;
+#else
+    return type == accessor->owner;
+#endif
+}
+
 void py_class_property_getter(Local<Name> js_name, Info(Value)) {
+    MIXED_PROFILER_SCOPE;
     HandleScope hs(isolate);
     Local<Context> context = isolate->GetCurrentContext();
+    py_accessor *accessor = (py_accessor *) info.Data().As<External>()->Value();
+    PyObject *self = get_self(info);
 
-    PyObject *name = py_from_js(js_name, context);
-    JS_PROPAGATE_PY(name);
-    PyObject *value = PyObject_GetAttr(get_self(info), name);
+    PyObject *value;
+    enum accessor_kind kind = accessor->kind;
+    if (kind != ACCESSOR_GENERIC && !accessor_applies(accessor, self)) {
+        kind = ACCESSOR_GENERIC;
+    }
+    switch (kind) {
+        case ACCESSOR_MEMBER:
+            value = PyMember_GetOne((char *) self, ((PyMemberDescrObject *) accessor->descriptor)->d_member);
+            break;
+        case ACCESSOR_PROPERTY:
+            if (accessor->fget != NULL) {
+                value = PyObject_CallFunctionObjArgs(accessor->fget, self, NULL);
+                break;
+            }
+            value = PyObject_GetAttr(self, accessor->name);
+            break;
+        case ACCESSOR_DESCRIPTOR:
+            value = Py_TYPE(accessor->descriptor)->tp_descr_get(accessor->descriptor, self, (PyObject *) Py_TYPE(self));
+            break;
+        default:
+            value = PyObject_GetAttr(self, accessor->name);
+    }
     JS_PROPAGATE_PY(value);
     info.GetReturnValue().Set(js_from_py(value, context));
+    Py_DECREF(value);
 }
 
 void py_class_property_setter(Local<Name> js_name, Local<Value> js_value, Info(void)) {
+    MIXED_PROFILER_SCOPE;
     HandleScope hs(isolate);
     Local<Context> context = isolate->GetCurrentContext();
+    py_accessor *accessor = (py_accessor *) info.Data().As<External>()->Value();
+    PyObject *self = get_self(info);
 
-    PyObject *name = py_from_js(js_name, context);
-    JS_PROPAGATE_PY(name);
     PyObject *value = py_from_js(js_value, context);
     JS_PROPAGATE_PY(value);
-    int result = PyObject_SetAttr(get_self(info), name, value);
+    int result;
+    enum accessor_kind kind = accessor->kind;
+    if (kind != ACCESSOR_GENERIC && !accessor_applies(accessor, self)) {
+        kind = ACCESSOR_GENERIC;
+    }
+    switch (kind) {
+        case ACCESSOR_MEMBER:
+            result = PyMember_SetOne((char *) self, ((PyMemberDescrObject *) accessor->descriptor)->d_member, value);
+            break;
+        case ACCESSOR_PROPERTY:
+            if (accessor->fset != NULL) {
+                PyObject *ret = PyObject_CallFunctionObjArgs(accessor->fset, self, value, NULL);
+                Py_XDECREF(ret);
+                result = ret == NULL ? -1 : 0;
+                break;
+            }
+            result = PyObject_SetAttr(self, accessor->name, value);
+            break;
+        case ACCESSOR_DESCRIPTOR:
+            result = Py_TYPE(accessor->descriptor)->tp_descr_set(accessor->descriptor, self, value);
+            break;
+        default:
+            result = PyObject_SetAttr(self, accessor->name, value);
+    }
+    Py_DECREF(value);
     JS_PROPAGATE_PY_(result);
 }
 
@@ -6,6 +6,10 @@
 #include "context.h"
 #include "convert.h"
 #include "pyfunction.h"
+#include "stats.h"
+#include "mixedprofiler.h"
+#include "tracing.h"
+#include "hooks.h"
 
 PyTypeObject py_function_type = {
     PyVarObject_HEAD_INIT(NULL, 0)
@@ -16,9 +20,21 @@ int py_function_type_init() {
     py_function_type.tp_basicsize = sizeof(py_function);
     py_function_type.tp_flags = Py_TPFLAGS_DEFAULT;
     py_function_type.tp_doc = "";
+    py_function_type.tp_dealloc = (destructor) py_function_dealloc;
     return PyType_Ready(&py_function_type);
 }
 
+void py_function_dealloc(py_function *self) {
+    if (self->js_template != NULL) {
+        self->js_template->Reset();
+        delete self->js_template;
+    }
+    Py_XDECREF(self->function);
+    Py_XDECREF(self->function_name);
+    convert_plan_free(self->plan);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
 static void py_function_callback(const FunctionCallbackInfo<Value> &info);
 
 PyObject *py_function_new(PyObject *function) {
@@ -30,6 +46,7 @@ PyObject *py_function_new(PyObject *function) {
     Py_INCREF(function);
     self->function = function;
     self->function_name = PyObject_GetAttrString(function, "__name__");
+    self->plan = convert_plan_new(function, false);
 
     // I've discovered that v8 trades memory leaks for speed. If you allocate a
     // FunctionTemplate and instantiate it, the FunctionTemplate, callback
@@ -40,6 +57,12 @@ PyObject *py_function_new(PyObject *function) {
 
     Local<External> js_self = External::New(isolate, self);
     Local<FunctionTemplate> js_template = FunctionTemplate::New(isolate, py_function_callback, js_self);
+    // so functions instantiated straight from the template, like the ones
+    // on a cloned context's global, still get a name
+    if (self->function_name != NULL && PyString_Check(self->function_name)) {
+        Local<Context> no_ctx;
+        js_template->SetClassName(js_from_py(self->function_name, no_ctx).As<String>());
+    }
     self->js_template->Reset(isolate, js_template);
 
     return (PyObject *) self;
@@ -74,16 +97,60 @@ Local<Function> py_template_to_function(py_function *self, Local<Context> contex
 
 static void py_function_callback(const FunctionCallbackInfo<Value> &info) {
     HandleScope hs(isolate);
+    TRACE_EVENT(trace_v8py, "Python function");
     Local<Context> context = isolate->GetCurrentContext();
 
     py_function *self = (py_function *) info.Data().As<External>()->Value();
-    PyObject *args = pys_from_jss(info, context);
+#ifdef HAVE_VECTORCALL
+    int argc = info.Length();
+    // slot 0 is scratch space for the callee, see PY_VECTORCALL_ARGUMENTS_OFFSET
+    PyObject *args_stack[ARGS_STACK_SIZE + 1];
+    PyObject **args = argc <= ARGS_STACK_SIZE ? args_stack : new PyObject *[argc + 1];
+    if (pys_from_jss_array(info, &args[1], context, self->plan) < 0) {
+        if (args != args_stack) delete[] args;
+        js_throw_py();
+        return;
+    }
+    HOOK_CALLBACK(HOOK_CALLBACK_ENTER, self->function);
+    MIXED_PROFILER_ENTER;
+    STATS_START(context);
+    PyObject *result = PyObject_Vectorcall(self->function, &args[1], argc | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
+    STATS_STOP(callbacks, callback_time);
+    MIXED_PROFILER_EXIT;
+    HOOK_CALLBACK(HOOK_CALLBACK_EXIT, self->function);
+    for (int i = 0; i < argc; i++) {
+        Py_DECREF(args[i + 1]);
+    }
+    if (args != args_stack) delete[] args;
+#else
+    PyObject *args = PyTuple_New(info.Length());
     JS_PROPAGATE_PY(args);
+    if (pys_from_jss_array(info, &PyTuple_GET_ITEM(args, 0), context, self->plan) < 0) {
+        Py_DECREF(args);
+        js_throw_py();
+        return;
+    }
+    HOOK_CALLBACK(HOOK_CALLBACK_ENTER, self->function);
+    MIXED_PROFILER_ENTER;
+    STATS_START(context);
     PyObject *result = PyObject_CallObject(self->function, args);
-    JS_PROPAGATE_PY(result);
+    STATS_STOP(callbacks, callback_time);
+    MIXED_PROFILER_EXIT;
+    HOOK_CALLBACK(HOOK_CALLBACK_EXIT, self->function);
     Py_DECREF(args);
-    Local<Value> js_result = js_from_py(result, context);
+#endif
+    JS_PROPAGATE_PY(result);
+    Local<Value> js_result;
+    if (self->plan != NULL) {
+        js_result = js_from_py_planned(self->plan->ret, result, context);
+        if (js_result.IsEmpty()) {
+            Py_DECREF(result);
+            js_throw_py();
+            return;
+        }
+    } else {
+        js_result = js_from_py(result, context);
+    }
     Py_DECREF(result);
     info.GetReturnValue().Set(js_result);
 }
-
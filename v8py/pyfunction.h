@@ -4,6 +4,8 @@
 #include <Python.h>
 #include <v8.h>
 
+#include "convert.h"
+
 using namespace v8;
 
 typedef struct {
@@ -11,6 +13,8 @@ typedef struct {
     PyObject *function;
     PyObject *function_name;
     Persistent<FunctionTemplate> *js_template;
+    // NULL if the function has no useful annotations
+    convert_plan *plan;
 } py_function;
 int py_function_type_init();
 
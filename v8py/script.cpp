@@ -3,6 +3,7 @@
 #include <v8.h>
 
 #include "convert.h"
+#include "context.h"
 #include "script.h"
 
 using namespace v8;
@@ -30,7 +31,10 @@ PyTypeObject script_type = {
 };
 int script_type_init() {
     IN_V8;
-    compile_context.Set(isolate, Context::New(isolate));
+    Local<Context> context = Context::New(isolate);
+    // it doesn't belong to a Context object
+    context->SetEmbedderData(CONTEXT_OBJECT_SLOT, External::New(isolate, NULL));
+    compile_context.Set(isolate, context);
 
     PyObject *weakref_module = PyImport_ImportModule("weakref");
     PyErr_PROPAGATE_(weakref_module);
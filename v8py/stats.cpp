@@ -0,0 +1,35 @@
+#include <Python.h>
+#include "v8py.h"
+#include <v8.h>
+
+#include "context.h"
+#include "stats.h"
+
+int stats_enabled = 0;
+
+context_stats *context_stats_for(Local<Context> context) {
+    if (context.IsEmpty()) {
+        context = isolate->GetCurrentContext();
+        if (context.IsEmpty()) {
+            return NULL;
+        }
+    }
+    // the script compiling context doesn't belong to a Context object
+    context_c *ctx_c = (context_c *) context->GetEmbedderData(CONTEXT_OBJECT_SLOT).As<External>()->Value();
+    return ctx_c != NULL ? ctx_c->stats : NULL;
+}
+
+PyObject *py_from_context_stats(context_stats *stats) {
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:d,s:K,s:K,s:d,s:K,s:d}",
+            "py_from_js", stats->py_from_js,
+            "py_from_js_bytes", stats->py_from_js_bytes,
+            "js_from_py", stats->js_from_py,
+            "js_from_py_bytes", stats->js_from_py_bytes,
+            "callbacks", stats->callbacks,
+            "callback_time", stats->callback_time,
+            "evals", stats->evals,
+            "calls", stats->calls,
+            "js_time", stats->js_time,
+            "timeouts", stats->timeouts,
+            "timeout_setup_time", stats->timeout_setup_time);
+}
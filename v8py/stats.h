@@ -0,0 +1,55 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <Python.h>
+#include <v8.h>
+
+using namespace v8;
+
+// Counters for what crosses between Python and JS in a context. They're only
+// kept for contexts created with stats=True. While no context wants them,
+// each counter costs one branch on stats_enabled. Times are in seconds.
+typedef struct {
+    unsigned PY_LONG_LONG py_from_js;
+    // UTF-16 for JS strings
+    unsigned PY_LONG_LONG py_from_js_bytes;
+    unsigned PY_LONG_LONG js_from_py;
+    // UTF-8 for Python strings, raw for bytes
+    unsigned PY_LONG_LONG js_from_py_bytes;
+    // Python functions and methods called from JS, and the time spent in them
+    unsigned PY_LONG_LONG callbacks;
+    double callback_time;
+    // JS run from Python, and the time spent running it
+    unsigned PY_LONG_LONG evals;
+    unsigned PY_LONG_LONG calls;
+    double js_time;
+    // runs with a timeout armed, and the time spent arming them
+    unsigned PY_LONG_LONG timeouts;
+    double timeout_setup_time;
+} context_stats;
+
+// the number of contexts collecting stats
+extern int stats_enabled;
+
+// NULL if the context isn't collecting stats. An empty context means the
+// current one.
+context_stats *context_stats_for(Local<Context> context);
+PyObject *py_from_context_stats(context_stats *stats);
+
+#define STATS_ADD(context, counter, amount) \
+    if (stats_enabled) { \
+        context_stats *stats_ = context_stats_for(context); \
+        if (stats_ != NULL) stats_->counter += (amount); \
+    }
+
+// Times what happens between STATS_START and STATS_STOP, and counts it.
+#define STATS_START(context) \
+    context_stats *timed_stats_ = stats_enabled ? context_stats_for(context) : NULL; \
+    double timed_start_ = timed_stats_ != NULL ? platform_time() : 0;
+#define STATS_STOP(counter, time_counter) \
+    if (timed_stats_ != NULL) { \
+        timed_stats_->counter++; \
+        timed_stats_->time_counter += platform_time() - timed_start_; \
+    }
+
+#endif
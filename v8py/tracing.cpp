@@ -0,0 +1,227 @@
+#include <Python.h>
+#include "v8py.h"
+#include <v8.h>
+#include <libplatform/libplatform.h>
+#include <libplatform/v8-tracing.h>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "tracing.h"
+
+using namespace v8;
+using namespace v8::platform::tracing;
+
+// the phase for an event with a duration, which is what trace_begin makes
+#define TRACE_PHASE_COMPLETE 'X'
+#define V8PY_CATEGORY "v8py"
+#define V8PY_CONVERT_CATEGORY "v8py.convert"
+
+// there's nothing to trace until tracing_init finds the real flags
+static const uint8_t trace_disabled = 0;
+const uint8_t *trace_v8py = &trace_disabled;
+const uint8_t *trace_v8py_convert = &trace_disabled;
+
+// owned by the platform
+static TracingController *tracing_controller = NULL;
+static std::ofstream *trace_file = NULL;
+
+// libplatform's ring buffer only writes anything out when tracing stops, and
+// by then it's thrown away everything but the latest events. This one keeps
+// the same number of chunks, but writes the oldest one out instead of
+// throwing it away, so the whole trace ends up in the file. An event that's
+// still going when its chunk is written goes out without its duration, and
+// those are counted so stop_tracing can say so.
+class StreamingTraceBuffer : public TraceBuffer {
+    public:
+        StreamingTraceBuffer(size_t max_chunks, TraceWriter *writer)
+            : chunks_(max_chunks), current_(0), seq_(0), unfinished_(0), writer_(writer) {}
+        ~StreamingTraceBuffer() override {
+            // the writer closes the JSON when it goes
+            delete writer_;
+        }
+
+        TraceObject *AddTraceEvent(uint64_t *handle) override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (chunks_[current_] == nullptr) {
+                chunks_[current_].reset(new TraceBufferChunk(seq_++));
+            } else if (chunks_[current_]->IsFull()) {
+                current_ = (current_ + 1) % chunks_.size();
+                if (chunks_[current_] == nullptr) {
+                    chunks_[current_].reset(new TraceBufferChunk(seq_++));
+                } else {
+                    write_chunk(chunks_[current_].get());
+                    chunks_[current_]->Reset(seq_++);
+                }
+            }
+            TraceBufferChunk *chunk = chunks_[current_].get();
+            size_t event_index;
+            TraceObject *event = chunk->AddTraceEvent(&event_index);
+            *handle = make_handle(current_, chunk->seq(), event_index);
+            return event;
+        }
+
+        // this is only asked for to fill in durations
+        TraceObject *GetEventByHandle(uint64_t handle) override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t chunk_index, event_index;
+            uint32_t seq;
+            extract_handle(handle, &chunk_index, &seq, &event_index);
+            TraceBufferChunk *chunk = chunks_[chunk_index].get();
+            if (chunk == nullptr || chunk->seq() != seq || event_index >= chunk->size()) {
+                // it's already been written
+                unfinished_++;
+                return NULL;
+            }
+            return chunk->GetEventAt(event_index);
+        }
+
+        // writes what's left, oldest first
+        bool Flush() override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 1; i <= chunks_.size(); i++) {
+                std::unique_ptr<TraceBufferChunk> &chunk = chunks_[(current_ + i) % chunks_.size()];
+                if (chunk != nullptr) {
+                    write_chunk(chunk.get());
+                    chunk.reset();
+                }
+            }
+            current_ = 0;
+            writer_->Flush();
+            return true;
+        }
+
+        size_t unfinished() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return unfinished_;
+        }
+
+    private:
+        void write_chunk(TraceBufferChunk *chunk) {
+            for (size_t i = 0; i < chunk->size(); i++) {
+                writer_->AppendTraceEvent(chunk->GetEventAt(i));
+            }
+        }
+        uint64_t make_handle(size_t chunk_index, uint32_t seq, size_t event_index) {
+            return ((uint64_t) seq * chunks_.size() + chunk_index) * TraceBufferChunk::kChunkSize + event_index;
+        }
+        void extract_handle(uint64_t handle, size_t *chunk_index, uint32_t *seq, size_t *event_index) {
+            *event_index = handle % TraceBufferChunk::kChunkSize;
+            handle /= TraceBufferChunk::kChunkSize;
+            *chunk_index = handle % chunks_.size();
+            *seq = (uint32_t) (handle / chunks_.size());
+        }
+
+        std::mutex mutex_;
+        std::vector<std::unique_ptr<TraceBufferChunk>> chunks_;
+        size_t current_;
+        uint32_t seq_;
+        size_t unfinished_;
+        TraceWriter *writer_;
+};
+// owned by the tracing controller while tracing
+static StreamingTraceBuffer *trace_buffer = NULL;
+
+void tracing_init() {
+    tracing_controller = new TracingController();
+    // there's no buffer until tracing starts
+    tracing_controller->Initialize(NULL);
+    platform::SetTracingController(current_platform, tracing_controller);
+    trace_v8py = current_platform->GetCategoryGroupEnabled(V8PY_CATEGORY);
+    trace_v8py_convert = current_platform->GetCategoryGroupEnabled(V8PY_CONVERT_CATEGORY);
+}
+
+uint64_t trace_begin(const uint8_t *category, const char *name) {
+    return current_platform->AddTraceEvent(TRACE_PHASE_COMPLETE, category, name,
+            NULL, 0, 0, 0, NULL, NULL, NULL, 0);
+}
+
+void trace_end(const uint8_t *category, const char *name, uint64_t handle) {
+    current_platform->UpdateTraceEventDuration(category, name, handle);
+}
+
+static const char *default_categories[] = {"v8", "v8.execute", "v8.compile", V8PY_CATEGORY, NULL};
+
+// Traces the given categories (a list of strings) into the file named. Events
+// are written as tracing goes, and the file is complete once it stops.
+PyObject *start_tracing(PyObject *shit, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"file", "categories", NULL};
+    const char *filename;
+    PyObject *categories = Py_None;
+    if (PyArg_ParseTupleAndKeywords(args, kwargs, "s|O", (char **) keywords, &filename, &categories) < 0) {
+        return NULL;
+    }
+    if (trace_file != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "tracing is already running");
+        return NULL;
+    }
+
+    TraceConfig *config = new TraceConfig();
+    if (categories == Py_None) {
+        for (const char **category = default_categories; *category != NULL; category++) {
+            config->AddIncludedCategory(*category);
+        }
+    } else {
+        PyObject *categories_seq = PySequence_Fast(categories, "categories must be a sequence of strings");
+        if (categories_seq == NULL) {
+            delete config;
+            return NULL;
+        }
+        for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(categories_seq); i++) {
+            PyObject *category = PySequence_Fast_GET_ITEM(categories_seq, i);
+            PyObject *category_bytes = PyString_Check(category) ? PyUnicode_AsUTF8String(category) : NULL;
+            if (category_bytes == NULL) {
+                if (!PyErr_Occurred()) {
+                    PyErr_SetString(PyExc_TypeError, "categories must be a sequence of strings");
+                }
+                Py_DECREF(categories_seq);
+                delete config;
+                return NULL;
+            }
+            config->AddIncludedCategory(PyString_AS_STRING(category_bytes));
+            Py_DECREF(category_bytes);
+        }
+        Py_DECREF(categories_seq);
+    }
+
+    trace_file = new std::ofstream(filename);
+    if (!trace_file->is_open()) {
+        delete trace_file;
+        trace_file = NULL;
+        delete config;
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+        return NULL;
+    }
+    TraceWriter *writer = TraceWriter::CreateJSONTraceWriter(*trace_file);
+    trace_buffer = new StreamingTraceBuffer(TraceBuffer::kRingBufferChunks, writer);
+    tracing_controller->Initialize(trace_buffer);
+    // takes the config
+    tracing_controller->StartTracing(config);
+    Py_RETURN_NONE;
+}
+
+// Returns how many events were written out before they finished, which have
+// no duration in the file.
+PyObject *stop_tracing(PyObject *shit, PyObject *noargs) {
+    if (trace_file == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "tracing is not running");
+        return NULL;
+    }
+    // this flushes the buffer into the writer
+    tracing_controller->StopTracing();
+    size_t unfinished = trace_buffer->unfinished();
+    // and getting rid of the buffer gets rid of the writer, which is what
+    // closes the JSON
+    tracing_controller->Initialize(NULL);
+    trace_buffer = NULL;
+    trace_file->close();
+    bool failed = trace_file->fail();
+    delete trace_file;
+    trace_file = NULL;
+    if (failed) {
+        PyErr_SetString(PyExc_IOError, "the trace file couldn't be written");
+        return NULL;
+    }
+    return PyLong_FromSize_t(unfinished);
+}
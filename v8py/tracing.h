@@ -0,0 +1,42 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <Python.h>
+#include <v8.h>
+#include <stdint.h>
+
+using namespace v8;
+
+// Trace events go through libplatform's tracing controller into a Chrome
+// trace JSON file, which chrome://tracing and Perfetto can both load.
+PyObject *start_tracing(PyObject *shit, PyObject *args, PyObject *kwargs);
+PyObject *stop_tracing(PyObject *shit, PyObject *noargs);
+void tracing_init();
+
+// v8py's own categories. Each points at a flag that's nonzero while the
+// category is being traced. Conversions happen so often that they get their
+// own category.
+extern const uint8_t *trace_v8py;
+extern const uint8_t *trace_v8py_convert;
+
+uint64_t trace_begin(const uint8_t *category, const char *name);
+void trace_end(const uint8_t *category, const char *name, uint64_t handle);
+
+// Covers the rest of the scope it's in, however that's left. While the
+// category isn't being traced it costs a branch on each end.
+struct trace_event {
+    const uint8_t *category;
+    const char *name;
+    bool started;
+    uint64_t handle;
+    trace_event(const uint8_t *category, const char *name)
+            : category(category), name(name), started(*category != 0), handle(0) {
+        if (started) handle = trace_begin(category, name);
+    }
+    ~trace_event() {
+        if (started) trace_end(category, name, handle);
+    }
+};
+#define TRACE_EVENT(category, name) trace_event trace_event_(category, name)
+
+#endif
@@ -10,29 +10,43 @@
 #include "pyclass.h"
 #include "jsobject.h"
 #include "debugger.h"
+#include "heap.h"
+#include "heapprofiler.h"
+#include "cpuprofiler.h"
+#include "mixedprofiler.h"
+#include "perfmap.h"
+#include "tracing.h"
+#include "hooks.h"
 
 using namespace v8;
 
-static Platform *current_platform = NULL;
+Platform *current_platform = NULL;
 Isolate *isolate = NULL;
 void initialize_v8() {
     if (current_platform == NULL) {
         V8::InitializeICU();
         current_platform = platform::CreateDefaultPlatform();
+        tracing_init();
         V8::InitializePlatform(current_platform);
         V8::Initialize();
         // strlen is slow but that doesn't matter much here because this only happens once
         V8::SetFlagsFromString("--expose_gc", strlen("--expose_gc"));
+        perf_map_set_flags();
 
         Isolate::CreateParams create_params;
         create_params.array_buffer_allocator = ArrayBuffer::Allocator::NewDefaultAllocator();
         isolate = Isolate::New(create_params);
-        isolate->SetCaptureStackTraceForUncaughtExceptions(true, 100, 
+        isolate->SetCaptureStackTraceForUncaughtExceptions(true, DEFAULT_STACK_TRACE_LIMIT, 
                 // sadly the v8 people screwed up and require me to cast this into to an enum
                 static_cast<StackTrace::StackTraceOptions>(StackTrace::kOverview | StackTrace::kScriptId));
+        perf_map_setup();
     }
 }
 
+double platform_time() {
+    return current_platform->MonotonicallyIncreasingTime();
+}
+
 PyObject *mark_hidden(PyObject *shit, PyObject *thing) {
     if (PyObject_SetAttrString(thing, "__v8py_hidden__", Py_True) < 0) {
         return NULL;
@@ -112,6 +126,27 @@ static PyMethodDef v8_methods[] = {
     {"unconstructable", mark_unconstructable, METH_O, ""},
     {"current_context", context_get_current, METH_NOARGS, ""},
     {"new", construct_new_object, METH_VARARGS, "Creates a new JavaScript object from a given constructor function"},
+    {"heap_statistics", heap_statistics, METH_NOARGS, "Returns statistics about the V8 heap as a dict"},
+    {"heap_space_statistics", heap_space_statistics, METH_NOARGS, "Returns statistics about each V8 heap space as a dict"},
+    {"idle_notification", idle_notification, METH_O, "Gives V8 the given number of seconds to do idle-time work like GC"},
+    {"memory_pressure_notification", memory_pressure_notification, METH_O, ""},
+    {"low_memory_notification", low_memory_notification, METH_NOARGS, "Forces V8 to free as much memory as it can"},
+    {"add_gc_callback", add_gc_callback, METH_O, "Calls the given function with a dict describing each GC, some time after it happens"},
+    {"remove_gc_callback", remove_gc_callback, METH_O, ""},
+    {"flush_gc_events", flush_gc_events, METH_NOARGS, "Delivers buffered GC events now and returns how many were dropped"},
+    {"take_heap_snapshot", (PyCFunction) take_heap_snapshot, METH_VARARGS | METH_KEYWORDS, "Streams a .heapsnapshot to a filename or binary file"},
+    {"start_sampling_heap_profiler", (PyCFunction) start_sampling_heap_profiler, METH_VARARGS | METH_KEYWORDS, ""},
+    {"stop_sampling_heap_profiler", stop_sampling_heap_profiler, METH_NOARGS, "Stops the sampling heap profiler and returns the allocation tree"},
+    {"start_cpu_profiler", (PyCFunction) start_cpu_profiler, METH_VARARGS | METH_KEYWORDS, "Starts the CPU profiler, sampling every sample_interval microseconds"},
+    {"stop_cpu_profiler", stop_cpu_profiler, METH_NOARGS, "Stops the CPU profiler and returns the profile in .cpuprofile form"},
+    {"start_mixed_profiler", (PyCFunction) start_mixed_profiler, METH_VARARGS | METH_KEYWORDS, "Starts sampling the Python and JS stacks together every sample_interval microseconds"},
+    {"stop_mixed_profiler", stop_mixed_profiler, METH_NOARGS, "Stops the mixed profiler and returns a dict of folded stacks to sample counts"},
+    {"enable_perf_map", enable_perf_map, METH_NOARGS, "Starts writing JIT compiled code to /tmp/perf-<pid>.map for perf"},
+    {"disable_perf_map", disable_perf_map, METH_NOARGS, "Stops writing the perf map"},
+    {"start_tracing", (PyCFunction) start_tracing, METH_VARARGS | METH_KEYWORDS, "Starts writing trace events in the given categories to a Chrome trace file"},
+    {"stop_tracing", stop_tracing, METH_NOARGS, "Stops tracing, finishes the trace file and returns how many events in it have no duration"},
+    {"set_hook", (PyCFunction) set_hook, METH_VARARGS | METH_KEYWORDS, "Sends eval, callback and exception events to sink in batches, or stops if sink is None"},
+    {"flush_hook", flush_hook, METH_NOARGS, "Sends the hook's buffered events to the sink now"},
     {NULL},
 };
 
@@ -198,6 +233,8 @@ PyMODINIT_FUNC PyInit__v8py() {
     Py_INCREF(&js_function_type);
     PyModule_AddObject(module, "JSFunction", (PyObject *) &js_function_type);
 
+    if (js_batch_iterator_type_init() < 0) return FAIL;
+
     if (js_exception_type_init() < 0) return FAIL;
     Py_INCREF(&js_exception_type);
     PyModule_AddObject(module, "JSException", (PyObject *) &js_exception_type);
@@ -206,6 +243,10 @@ PyMODINIT_FUNC PyInit__v8py() {
     Py_INCREF(&js_terminated_type);
     PyModule_AddObject(module, "JavaScriptTerminated", (PyObject *) &js_terminated_type);
 
+    PyModule_AddIntConstant(module, "MEMORY_PRESSURE_NONE", (long) MemoryPressureLevel::kNone);
+    PyModule_AddIntConstant(module, "MEMORY_PRESSURE_MODERATE", (long) MemoryPressureLevel::kModerate);
+    PyModule_AddIntConstant(module, "MEMORY_PRESSURE_CRITICAL", (long) MemoryPressureLevel::kCritical);
+
     if (null_type_init() < 0) return FAIL;
     Py_INCREF(null_object);
     PyModule_AddObject(module, "Null", null_object);
@@ -16,7 +16,11 @@
 
 using namespace v8;
 
+extern Platform *current_platform;
 extern Isolate *isolate;
+// seconds on the platform's clock, the one V8 takes idle deadlines on. Only
+// v8py.cpp can call the platform, because v8.h doesn't define it.
+double platform_time();
 extern PyObject *null_object;
 #define STRING_BUFFER_SIZE 512
 static uint16_t string_buffer[STRING_BUFFER_SIZE] = {};